@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+
+#include "gl.h"
+#include "headless.h"
+
+static double headless__ms(Uint64 dt)
+{
+	return (double)dt * 1e3 / (double)SDL_GetPerformanceFrequency();
+}
+
+int headless_init(struct headless* h, int argc, char** argv)
+{
+	memset(h, 0, sizeof *h);
+	h->n_frames = 100;
+	h->width = 1920;
+	h->height = 1080;
+	int headless = 0;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--headless") == 0) {
+			headless = 1;
+		} else if (strcmp(argv[i], "--frames") == 0 && i+1 < argc) {
+			h->n_frames = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--size") == 0 && i+1 < argc) {
+			if (sscanf(argv[++i], "%dx%d", &h->width, &h->height) != 2) {
+				fprintf(stderr, "--size wants WxH, not %s\n", argv[i]);
+				exit(EXIT_FAILURE);
+			}
+		} else if (strcmp(argv[i], "--sw") == 0) {
+			h->software = 1;
+		} else if (strcmp(argv[i], "--out") == 0 && i+1 < argc) {
+			h->out_path = argv[++i];
+		}
+	}
+	if (!headless) return 0;
+	if (h->n_frames < 1 || h->width < 1 || h->height < 1) {
+		fprintf(stderr, "bad --frames or --size\n");
+		exit(EXIT_FAILURE);
+	}
+	if (h->out_path != NULL && !h->software) {
+		fprintf(stderr, "--out needs --sw\n");
+		exit(EXIT_FAILURE);
+	}
+
+	#ifdef BUILD_LINUX
+	/* keeps an SDL_VIDEODRIVER from the environment */
+	if (!h->software) SDL_setenv("SDL_VIDEODRIVER", "offscreen", 0);
+	#endif
+
+	h->cpu_ms = calloc(h->n_frames, sizeof *h->cpu_ms);
+	h->frame_ms = calloc(h->n_frames, sizeof *h->frame_ms);
+	if (h->cpu_ms == NULL || h->frame_ms == NULL) {
+		fprintf(stderr, "out of memory\n");
+		abort();
+	}
+	return 1;
+}
+
+void headless_frame_begin(struct headless* h)
+{
+	h->t_frame = SDL_GetPerformanceCounter();
+	if (h->frame == 0) h->t_start = h->t_frame;
+}
+
+int headless_frame_end(struct headless* h)
+{
+	h->cpu_ms[h->frame] = headless__ms(SDL_GetPerformanceCounter() - h->t_frame);
+	if (!h->software) glFinish();
+	h->frame_ms[h->frame] = headless__ms(SDL_GetPerformanceCounter() - h->t_frame);
+	h->frame++;
+	return h->frame >= h->n_frames;
+}
+
+static int headless__compare(const void* a, const void* b)
+{
+	const double da = *(const double*)a;
+	const double db = *(const double*)b;
+	return (da > db) - (da < db);
+}
+
+static void headless__stats(FILE* f, const char* name, const double* ms, int n)
+{
+	double* sorted = malloc(n * sizeof *sorted);
+	if (sorted == NULL) {
+		fprintf(stderr, "out of memory\n");
+		abort();
+	}
+	memcpy(sorted, ms, n * sizeof *sorted);
+	qsort(sorted, n, sizeof *sorted, headless__compare);
+	double sum = 0.0;
+	for (int i = 0; i < n; i++) sum += sorted[i];
+	const int p99 = (n*99 + 99) / 100 - 1;
+	fprintf(f, "  \"%s\": {\"min\": %.4f, \"median\": %.4f, \"p99\": %.4f, \"max\": %.4f, \"mean\": %.4f},\n",
+		name, sorted[0], sorted[n/2], sorted[p99], sorted[n-1], sum / n);
+	free(sorted);
+}
+
+void headless_save_frame(struct headless* h, const unsigned char* rgba, int stride)
+{
+	if (h->out_path == NULL) return;
+	FILE* f = fopen(h->out_path, "wb");
+	if (f == NULL) {
+		fprintf(stderr, "%s: cannot open for writing\n", h->out_path);
+		return;
+	}
+	fprintf(f, "P6\n%d %d\n255\n", h->width, h->height);
+	for (int y = 0; y < h->height; y++) {
+		const unsigned char* row = rgba + (size_t)y*stride;
+		for (int x = 0; x < h->width; x++) fwrite(row + x*4, 1, 3, f);
+	}
+	if (fclose(f) != 0) fprintf(stderr, "%s: write failed\n", h->out_path);
+}
+
+void headless_report(struct headless* h, const char* program)
+{
+	const double wall_ms = headless__ms(SDL_GetPerformanceCounter() - h->t_start);
+	const int n = h->frame;
+	FILE* f = stdout;
+	fprintf(f, "{\n");
+	fprintf(f, "  \"program\": \"%s\",\n", program);
+	const char* renderer = h->software ? "nanovg_sw" : (const char*)glGetString(GL_RENDERER);
+	fprintf(f, "  \"renderer\": \"%s\",\n", renderer ? renderer : "unknown");
+	fprintf(f, "  \"width\": %d,\n", h->width);
+	fprintf(f, "  \"height\": %d,\n", h->height);
+	fprintf(f, "  \"frames\": %d,\n", n);
+	fprintf(f, "  \"wall_ms\": %.3f,\n", wall_ms);
+	if (n > 0) {
+		headless__stats(f, "cpu_ms", h->cpu_ms, n);
+		headless__stats(f, "frame_ms", h->frame_ms, n);
+	}
+	fprintf(f, "  \"cpu_ms_per_frame\": [");
+	for (int i = 0; i < n; i++) fprintf(f, "%s%.4f", i > 0 ? ", " : "", h->cpu_ms[i]);
+	fprintf(f, "]\n");
+	fprintf(f, "}\n");
+}
+
+void headless_free(struct headless* h)
+{
+	free(h->cpu_ms);
+	free(h->frame_ms);
+	memset(h, 0, sizeof *h);
+}
@@ -0,0 +1,41 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <SDL.h>
+
+/* --headless [--frames N] [--size WxH]: the demos render N frames into an
+ * offscreen framebuffer without a display (SDL's offscreen video driver,
+ * which gives a surfaceless EGL context; Mesa's llvmpipe works), on a
+ * fixed animation clock, and print frame timings as JSON.
+ *
+ * With --sw they draw with nanovg_sw.c on the CPU instead, without GL at
+ * all, and --out FILE writes the last frame as a PPM image */
+struct headless {
+	int n_frames;
+	int width;
+	int height;
+	int software;
+	const char* out_path;
+
+	int frame;
+	Uint64 t_start;
+	Uint64 t_frame;
+	// per frame, in ms: until nvgEndFrame() returns, and until glFinish()
+	// (the same with --sw, where nvgEndFrame() does the drawing)
+	double* cpu_ms;
+	double* frame_ms;
+};
+
+/* returns 1 and fills in h if argv has --headless; before SDL_Init(),
+ * since it picks the video driver */
+int headless_init(struct headless* h, int argc, char** argv);
+void headless_frame_begin(struct headless* h);
+/* after nvgEndFrame(); waits for the GPU, and returns 1 once all frames are
+ * done */
+int headless_frame_end(struct headless* h);
+/* writes rgba (premultiplied, as nanovg_sw.c draws it) to --out, if given */
+void headless_save_frame(struct headless* h, const unsigned char* rgba, int stride);
+void headless_report(struct headless* h, const char* program);
+void headless_free(struct headless* h);
+
+#endif
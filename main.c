@@ -1,11 +1,15 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 
 #include <SDL.h>
 
 #include "gl.h"
 #include "nanovg.h"
+#include "nanovg_gl_utils.h"
 #include "stb_sprintf.h"
+#include "headless.h"
+#include "nanovg_sw.h"
 
 SDL_Window* window;
 
@@ -56,11 +60,18 @@ static void star(NVGcontext* vg, int n_teeth, float r1, float r2)
 
 int main(int argc, char** argv)
 {
-	assert(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER) == 0);
+	struct headless headless;
+	const int is_headless = headless_init(&headless, argc, argv);
+	const int is_software = is_headless && headless.software;
+
+	if (SDL_Init(is_software ? SDL_INIT_TIMER : SDL_INIT_VIDEO | SDL_INIT_TIMER) != 0) {
+		fprintf(stderr, "SDL_Init failed: %s\n", SDL_GetError());
+		abort();
+	}
 	atexit(SDL_Quit);
 
-	SDL_GLContext glctx;
-	{
+	SDL_GLContext glctx = NULL;
+	if (!is_software) {
 		#ifdef BUILD_LINUX
 		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
 		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 0);
@@ -78,8 +89,8 @@ int main(int argc, char** argv)
 		window = SDL_CreateWindow(
 				"SDL2/NanoVG/GLES3",
 				SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-				1920, 1080,
-				SDL_WINDOW_RESIZABLE | SDL_WINDOW_OPENGL | SDL_WINDOW_ALLOW_HIGHDPI);
+				is_headless ? headless.width : 1920, is_headless ? headless.height : 1080,
+				is_headless ? (SDL_WINDOW_HIDDEN | SDL_WINDOW_OPENGL) : (SDL_WINDOW_RESIZABLE | SDL_WINDOW_OPENGL | SDL_WINDOW_ALLOW_HIGHDPI));
 		if (window == NULL) {
 			fprintf(stderr, "SDL_CreateWindow failed: %s\n", SDL_GetError());
 			abort();
@@ -91,21 +102,49 @@ int main(int argc, char** argv)
 		}
 	}
 
-	NVGcontext* vg = nanovg_create_context();
-	assert(vg != NULL);
+	NVGcontext* vg = is_software ? nanovg_sw_create(NULL) : nanovg_create_context();
+	if (vg == NULL) {
+		fprintf(stderr, "nanovg_create_context failed\n");
+		abort();
+	}
 
-	int font = nvgCreateFont(vg, "sans", "./nanovg/example/Roboto-Regular.ttf");
-	assert(font != -1);
+	if (nvgCreateFont(vg, "sans", "./nanovg/example/Roboto-Regular.ttf") == -1) {
+		fprintf(stderr, "nvgCreateFont failed\n");
+		abort();
+	}
 
 	NVGpaint rpaint = nvgRadialGradient(vg, 0, 0, 0, 100, nvgRGBA(255,255,255,200), nvgRGBA(255,100,0,50));
 
 	int screen_width = 0;
 	int screen_height = 0;
 	float pixel_ratio = 0.0f;
-	window_size(&screen_width, &screen_height, &pixel_ratio);
+	NVGLUframebuffer* framebuffer = NULL;
+	unsigned char* software_framebuffer = NULL;
+	if (is_software) {
+		software_framebuffer = calloc((size_t)headless.width * headless.height, 4);
+		if (software_framebuffer == NULL) {
+			fprintf(stderr, "out of memory\n");
+			abort();
+		}
+		nanovg_sw_set_framebuffer(vg, software_framebuffer, headless.width, headless.height, headless.width*4);
+		screen_width = headless.width;
+		screen_height = headless.height;
+		pixel_ratio = 1.0f;
+	} else if (is_headless) {
+		framebuffer = nvgluCreateFramebuffer(vg, headless.width, headless.height, 0);
+		if (framebuffer == NULL) {
+			fprintf(stderr, "nvgluCreateFramebuffer failed\n");
+			abort();
+		}
+		screen_width = headless.width;
+		screen_height = headless.height;
+		pixel_ratio = 1.0f;
+	} else {
+		window_size(&screen_width, &screen_height, &pixel_ratio);
+	}
 
 	int swap_interval = 1;
-	SDL_GL_SetSwapInterval(1);
+	if (!is_software) SDL_GL_SetSwapInterval(1);
 
 	float phi = 0.0f;
 	int exiting = 0;
@@ -114,6 +153,8 @@ int main(int argc, char** argv)
 	int fullscreen = 0;
 	Uint32 last_ticks = 0;
 	while (!exiting) {
+		if (is_headless) headless_frame_begin(&headless);
+
 		SDL_Event e;
 		while (SDL_PollEvent(&e)) {
 			if (e.type == SDL_QUIT) {
@@ -136,14 +177,19 @@ int main(int argc, char** argv)
 			}
 		}
 
-		glViewport(0, 0, screen_width, screen_height);
-		glClearColor(0, 0.1, 0.4, 0);
-		glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-		glEnable(GL_CULL_FACE);
-		glDisable(GL_DEPTH_TEST);
+		if (is_software) {
+			nanovg_sw_clear(vg, nvgRGBAf(0, 0.1f, 0.4f, 0));
+		} else {
+			if (framebuffer != NULL) nvgluBindFramebuffer(framebuffer);
+			glViewport(0, 0, screen_width, screen_height);
+			glClearColor(0, 0.1, 0.4, 0);
+			glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			glEnable(GL_CULL_FACE);
+			glDisable(GL_DEPTH_TEST);
+		}
 
 		nvgBeginFrame(vg, screen_width / pixel_ratio, screen_height / pixel_ratio, pixel_ratio);
 
@@ -280,7 +326,11 @@ int main(int argc, char** argv)
 
 		nvgEndFrame(vg);
 
-		SDL_GL_SwapWindow(window);
+		if (is_headless) {
+			if (headless_frame_end(&headless)) exiting = 1;
+		} else {
+			SDL_GL_SwapWindow(window);
+		}
 
 		fps_counter++;
 		Uint32 ticks = SDL_GetTicks();
@@ -291,8 +341,20 @@ int main(int argc, char** argv)
 		}
 	}
 
-	SDL_GL_DeleteContext(glctx);
-	SDL_DestroyWindow(window);
+	if (is_headless) {
+		if (is_software) headless_save_frame(&headless, software_framebuffer, headless.width*4);
+		headless_report(&headless, "main");
+		headless_free(&headless);
+		nvgluDeleteFramebuffer(framebuffer);
+	}
+
+	if (is_software) {
+		nanovg_sw_delete(vg);
+		free(software_framebuffer);
+	} else {
+		SDL_GL_DeleteContext(glctx);
+		SDL_DestroyWindow(window);
+	}
 
 	return EXIT_SUCCESS;
 }
@@ -1,13 +1,33 @@
+#ifdef BUILD_LINUX
+#define _POSIX_C_SOURCE 200809L /* posix_memalign(), mmap() etc. under -std=c99 */
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdarg.h>
 #include <math.h>
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 #include <SDL.h>
 
 #include "gl.h"
 #include "nanovg.h"
+#include "nanovg_gl_utils.h"
 #include "stb_sprintf.h"
+#include "headless.h"
+#include "nanovg_sw.h"
 
 SDL_Window* window;
 
@@ -27,6 +47,297 @@ static void window_size(int* width, int* height, float* pixel_ratio)
 	*pixel_ratio = *width / w;
 }
 
+/* allocations that abort on failure; unlike assert((p = calloc(...)) != NULL)
+ * these survive -DNDEBUG */
+static void* xcalloc(size_t n, size_t size)
+{
+	void* p = calloc(n, size);
+	if (p == NULL && n > 0 && size > 0) {
+		fprintf(stderr, "out of memory (%zu×%zu bytes)\n", n, size);
+		abort();
+	}
+	return p;
+}
+
+static void* xrealloc(void* p, size_t size)
+{
+	p = realloc(p, size);
+	if (p == NULL && size > 0) {
+		fprintf(stderr, "out of memory (%zu bytes)\n", size);
+		abort();
+	}
+	return p;
+}
+
+/* one zeroed block handed out front to back and freed in one go. An arena
+ * with base == NULL only counts; run the same arena_alloc() calls on it
+ * first to find the size for arena_init() */
+struct arena {
+	char* base;
+	size_t size;
+	size_t used;
+	/* set if base points into a read-only mmap()ed file rather than an
+	 * allocation (see outline_load()); mapping_size is 0 if another arena
+	 * owns the mapping */
+	void* mapping;
+	size_t mapping_size;
+};
+
+#define ARENA_ALIGNMENT (64)
+
+/* zeroed and ARENA_ALIGNMENT aligned, which calloc() doesn't promise, so
+ * every arena_alloc() is aligned too */
+static char* arena__alloc_base(size_t size)
+{
+	void* p = NULL;
+	if (size == 0) size = 1;
+	if (posix_memalign(&p, ARENA_ALIGNMENT, size) != 0) {
+		fprintf(stderr, "out of memory (%zu bytes)\n", size);
+		abort();
+	}
+	memset(p, 0, size);
+	return p;
+}
+
+static void arena_init(struct arena* a, size_t size)
+{
+	a->base = arena__alloc_base(size);
+	a->size = size;
+	a->used = 0;
+}
+
+/* grows the block to size bytes; the block may move, so pointers into it
+ * must be handed out again (with the same arena_alloc() calls from an
+ * arena_reset()) */
+static void arena_grow(struct arena* a, size_t size)
+{
+	if (size <= a->size) return;
+	char* base = arena__alloc_base(size);
+	memcpy(base, a->base, a->size);
+	free(a->base);
+	a->base = base;
+	a->size = size;
+}
+
+static void arena_reset(struct arena* a)
+{
+	a->used = 0;
+}
+
+static void* arena_alloc(struct arena* a, size_t n, size_t size)
+{
+	const size_t offset = a->used;
+	a->used += (n*size + ARENA_ALIGNMENT-1) & ~(size_t)(ARENA_ALIGNMENT-1);
+	if (a->base == NULL) return NULL;
+	if (a->used > a->size) {
+		fprintf(stderr, "arena overflow (%zu > %zu bytes)\n", a->used, a->size);
+		abort();
+	}
+	return a->base + offset;
+}
+
+static void arena_free(struct arena* a)
+{
+	if (a->mapping != NULL) {
+		if (a->mapping_size > 0) munmap(a->mapping, a->mapping_size);
+	} else {
+		free(a->base);
+	}
+	memset(a, 0, sizeof *a);
+}
+
+/* fixed set of worker threads that run batches of jobs; pool_run() runs
+ * job indices 0..n_jobs-1 on the workers and on the calling thread, and
+ * returns when all jobs are done. pool_start() and pool_wait() are the two
+ * halves of pool_run(), so the caller can do other work in between.
+ * thread_index is 0 for the calling thread and 1..n_threads-1 for the
+ * workers, for per-thread scratch.
+ *
+ * Every thread starts a batch with an even share of the job indices and
+ * takes them front to back; a thread that runs out steals the back half
+ * of another thread's share, so uneven jobs still keep all threads busy */
+struct pool {
+	int n_threads;
+	struct pool_worker* workers; // [0] is the calling thread's share
+	SDL_mutex* mutex;
+	SDL_cond* start_cond;
+	SDL_cond* done_cond;
+	int generation;
+	int exiting;
+	int n_busy;
+	int running;
+	void (*fn)(void* usr, int job_index, int thread_index);
+	void* usr;
+};
+
+struct pool_worker {
+	struct pool* pool;
+	int thread_index;
+	SDL_Thread* thread;
+	/* job indices [begin;end) not taken yet */
+	SDL_SpinLock lock;
+	int begin;
+	int end;
+};
+
+static int pool__pop(struct pool_worker* w)
+{
+	int job_index = -1;
+	SDL_AtomicLock(&w->lock);
+	if (w->begin < w->end) job_index = w->begin++;
+	SDL_AtomicUnlock(&w->lock);
+	return job_index;
+}
+
+/* moves the back half of the next non-empty share into thief's (empty)
+ * share; returns 0 if all shares are empty */
+static int pool__steal(struct pool* p, struct pool_worker* thief)
+{
+	for (int k = 1; k < p->n_threads; k++) {
+		struct pool_worker* victim = &p->workers[(thief->thread_index + k) % p->n_threads];
+		int begin = 0;
+		int end = 0;
+		SDL_AtomicLock(&victim->lock);
+		const int n = victim->end - victim->begin;
+		if (n > 0) {
+			end = victim->end;
+			begin = end - (n+1)/2;
+			victim->end = begin;
+		}
+		SDL_AtomicUnlock(&victim->lock);
+		if (begin < end) {
+			SDL_AtomicLock(&thief->lock);
+			thief->begin = begin;
+			thief->end = end;
+			SDL_AtomicUnlock(&thief->lock);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void pool__work(struct pool* p, int thread_index)
+{
+	struct pool_worker* w = &p->workers[thread_index];
+	for (;;) {
+		const int job_index = pool__pop(w);
+		if (job_index >= 0) {
+			p->fn(p->usr, job_index, thread_index);
+		} else if (!pool__steal(p, w)) {
+			break;
+		}
+	}
+}
+
+static int pool__thread(void* usr)
+{
+	struct pool_worker* w = usr;
+	struct pool* p = w->pool;
+	int generation = 0;
+	SDL_LockMutex(p->mutex);
+	for (;;) {
+		while (!p->exiting && p->generation == generation) SDL_CondWait(p->start_cond, p->mutex);
+		if (p->exiting) break;
+		generation = p->generation;
+		SDL_UnlockMutex(p->mutex);
+
+		pool__work(p, w->thread_index);
+
+		SDL_LockMutex(p->mutex);
+		if (--p->n_busy == 0) SDL_CondSignal(p->done_cond);
+	}
+	SDL_UnlockMutex(p->mutex);
+	return 0;
+}
+
+/* n_threads includes the calling thread; 0 means one per CPU */
+static struct pool* pool_create(int n_threads)
+{
+	if (n_threads <= 0) n_threads = SDL_GetCPUCount();
+	if (n_threads < 1) n_threads = 1;
+	struct pool* p = xcalloc(1, sizeof *p);
+	p->n_threads = n_threads;
+	p->mutex = SDL_CreateMutex();
+	p->start_cond = SDL_CreateCond();
+	p->done_cond = SDL_CreateCond();
+	if (p->mutex == NULL || p->start_cond == NULL || p->done_cond == NULL) {
+		fprintf(stderr, "pool_create failed: %s\n", SDL_GetError());
+		abort();
+	}
+	p->workers = xcalloc(n_threads, sizeof *p->workers);
+	for (int i = 1; i < n_threads; i++) {
+		struct pool_worker* w = &p->workers[i];
+		w->pool = p;
+		w->thread_index = i;
+		w->thread = SDL_CreateThread(pool__thread, "pool", w);
+		if (w->thread == NULL) {
+			fprintf(stderr, "SDL_CreateThread failed: %s\n", SDL_GetError());
+			abort();
+		}
+	}
+	return p;
+}
+
+/* hands a batch to the workers and returns; the calling thread joins in
+ * at pool_wait(), which must come before the next pool_start() */
+static void pool_start(struct pool* p, int n_jobs, void (*fn)(void* usr, int job_index, int thread_index), void* usr)
+{
+	assert(!p->running);
+	if (n_jobs <= 0) return;
+	SDL_LockMutex(p->mutex);
+	p->fn = fn;
+	p->usr = usr;
+	for (int i = 0; i < p->n_threads; i++) {
+		struct pool_worker* w = &p->workers[i];
+		w->begin = (int)((int64_t)n_jobs * i / p->n_threads);
+		w->end = (int)((int64_t)n_jobs * (i+1) / p->n_threads);
+	}
+	p->n_busy = p->n_threads - 1;
+	p->running = 1;
+	p->generation++;
+	SDL_CondBroadcast(p->start_cond);
+	SDL_UnlockMutex(p->mutex);
+}
+
+/* runs jobs of the batch from pool_start() on the calling thread until
+ * none are left, then waits for the workers to finish theirs */
+static void pool_wait(struct pool* p)
+{
+	if (!p->running) return;
+	pool__work(p, 0);
+
+	SDL_LockMutex(p->mutex);
+	while (p->n_busy > 0) SDL_CondWait(p->done_cond, p->mutex);
+	p->running = 0;
+	SDL_UnlockMutex(p->mutex);
+}
+
+static void pool_run(struct pool* p, int n_jobs, void (*fn)(void* usr, int job_index, int thread_index), void* usr)
+{
+	pool_start(p, n_jobs, fn, usr);
+	pool_wait(p);
+}
+
+/* nanovg_sw.c's frames draw on the pool */
+static void pool_run_nanovg_sw(void* usr, int n_jobs, void (*fn)(void* usr, int job_index, int thread_index), void* fn_usr)
+{
+	pool_run(usr, n_jobs, fn, fn_usr);
+}
+
+static void pool_destroy(struct pool* p)
+{
+	SDL_LockMutex(p->mutex);
+	p->exiting = 1;
+	SDL_CondBroadcast(p->start_cond);
+	SDL_UnlockMutex(p->mutex);
+	for (int i = 1; i < p->n_threads; i++) SDL_WaitThread(p->workers[i].thread, NULL);
+	SDL_DestroyCond(p->start_cond);
+	SDL_DestroyCond(p->done_cond);
+	SDL_DestroyMutex(p->mutex);
+	free(p->workers);
+	free(p);
+}
+
 union v3 {
 	struct { float x,y,z; };
 	float s[3];
@@ -52,6 +363,13 @@ union v3 v3_axis_z()
 	return (union v3){.z=1};
 }
 
+union v3 v3_add(union v3 a, union v3 b)
+{
+	union v3 r;
+	for (int i = 0; i < 3; i++) r.s[i] = a.s[i] + b.s[i];
+	return r;
+}
+
 union v3 v3_sub(union v3 a, union v3 b)
 {
 	union v3 r;
@@ -121,6 +439,15 @@ union v3 m33_get_view_v3(union m33* m)
 	return m->basis_z;
 }
 
+/* how much m scales model lengths on screen (x,y); exact for a rotation
+ * times a uniform scale */
+float m33_get_projected_scale(union m33* m)
+{
+	const float sx = v3_length(m->basis_x);
+	const float sy = v3_length(m->basis_y);
+	return sx > sy ? sx : sy;
+}
+
 union v3 m33_apply(union m33* m, union v3 v)
 {
 	union v3 r;
@@ -137,44 +464,101 @@ void m33_set_identity(union m33* m)
 	}
 }
 
+/* Rodrigues' rotation formula, written out */
 void m33_set_rotate(union m33* m, float radians, union v3 axis)
 {
 	axis = v3_normalize(axis);
-	float c = cosf(radians);
-	float s = sinf(radians);
-	for (int i = 0; i < 3; i++) {
-		for (int j = 0; j < 3; j++) {
-			float x = axis.s[i] * axis.s[j] * (1-c);
-			if (i == j) {
-				x += c;
-			} else {
-				int k = 3-i-j;
-				assert(k >= 0 && k < 3);
-				float sgn0 = (i-j)&1 ? 1 : -1;
-				float sgn1 = (i-j)>0 ? 1 : -1;
-				x += axis.s[k] * s * sgn0 * sgn1;
-			}
-			m->b[i].s[j] = x;
-		}
-	}
+	const float c = cosf(radians);
+	const float s = sinf(radians);
+	const float t = 1.0f - c;
+	const float x = axis.x, y = axis.y, z = axis.z;
+	m->b[0] = (union v3){.x = x*x*t + c,   .y = x*y*t - z*s, .z = x*z*t + y*s};
+	m->b[1] = (union v3){.x = y*x*t + z*s, .y = y*y*t + c,   .z = y*z*t - x*s};
+	m->b[2] = (union v3){.x = z*x*t - y*s, .y = z*y*t + x*s, .z = z*z*t + c};
 }
 
+/* dst may be a or b. Row i of the product is the rows of b weighted by
+ * row i of a, so b is read row by row instead of gathering its columns
+ * (the sums come out in the same order as v3_dot() of a row and a column) */
 void m33_multiply(union m33* dst, union m33* a, union m33* b)
 {
+	union m33 r;
+	#if defined(__SSE2__)
+	/* rows of b padded to 4 lanes; lane 3 of the first two is the start
+	 * of the next row, and is thrown away */
+	const __m128 b0 = _mm_loadu_ps(b->b[0].s);
+	const __m128 b1 = _mm_loadu_ps(b->b[1].s);
+	const __m128 b2 = _mm_setr_ps(b->b[2].s[0], b->b[2].s[1], b->b[2].s[2], 0.0f);
 	for (int i = 0; i < 3; i++) {
-		for (int j = 0; j < 3; j++) {
-			dst->b[i].s[j] = v3_dot(m33_row(a, i), m33_col(b, j));
+		float row[4];
+		_mm_storeu_ps(row, _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(_mm_set1_ps(a->b[i].s[0]), b0),
+			_mm_mul_ps(_mm_set1_ps(a->b[i].s[1]), b1)),
+			_mm_mul_ps(_mm_set1_ps(a->b[i].s[2]), b2)));
+		for (int j = 0; j < 3; j++) r.b[i].s[j] = row[j];
+	}
+	#else
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 3; j++) r.b[i].s[j] = a->b[i].s[0] * b->b[0].s[j];
+		for (int k = 1; k < 3; k++) {
+			for (int j = 0; j < 3; j++) r.b[i].s[j] += a->b[i].s[k] * b->b[k].s[j];
 		}
 	}
+	#endif
+	*dst = r;
 }
 
 void m33_multiply_inplace(union m33* dst, union m33* m)
 {
-	union m33 result;
-	m33_multiply(&result, dst, m);
-	memcpy(dst, &result, sizeof result);
+	m33_multiply(dst, dst, m);
 }
 
+/* out[i] = m33_apply(m, in[i]), same results to the bit; in and out may be
+ * the same array. The SSE2 path transforms 4 vertices at a time: their 12
+ * floats are loaded as 3 vectors, shuffled into x/y/z lanes, transformed,
+ * and shuffled back */
+void m33_apply_batch(const union m33* m, const union v3* in, union v3* out, int n)
+{
+	int i = 0;
+	#if defined(__SSE2__)
+	{
+		__m128 r[3][3];
+		for (int row = 0; row < 3; row++) for (int col = 0; col < 3; col++) r[row][col] = _mm_set1_ps(m->b[row].s[col]);
+		for (; i+4 <= n; i += 4) {
+			const float* src = in[i].s;
+			const __m128 a = _mm_loadu_ps(src);   // x0 y0 z0 x1
+			const __m128 b = _mm_loadu_ps(src+4); // y1 z1 x2 y2
+			const __m128 c = _mm_loadu_ps(src+8); // z2 x3 y3 z3
+			const __m128 x2x3 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(0,1,0,2));
+			const __m128 x = _mm_shuffle_ps(a, x2x3, _MM_SHUFFLE(2,0,3,0));
+			const __m128 y0y1 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0,0,1,1));
+			const __m128 y2y3 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2,2,3,3));
+			const __m128 y = _mm_shuffle_ps(y0y1, y2y3, _MM_SHUFFLE(2,0,2,0));
+			const __m128 z0z1 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1,1,2,2));
+			const __m128 z2z3 = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3,3,0,0));
+			const __m128 z = _mm_shuffle_ps(z0z1, z2z3, _MM_SHUFFLE(2,0,2,0));
+
+			/* same operation order as v3_dot() */
+			__m128 t[3];
+			for (int row = 0; row < 3; row++) {
+				t[row] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, r[row][0]), _mm_mul_ps(y, r[row][1])), _mm_mul_ps(z, r[row][2]));
+			}
+
+			const __m128 xy01 = _mm_unpacklo_ps(t[0], t[1]); // x0 y0 x1 y1
+			const __m128 xy23 = _mm_unpackhi_ps(t[0], t[1]); // x2 y2 x3 y3
+			const __m128 z0x1 = _mm_shuffle_ps(t[2], xy01, _MM_SHUFFLE(2,2,0,0));
+			const __m128 y1z1 = _mm_shuffle_ps(xy01, t[2], _MM_SHUFFLE(1,1,3,3));
+			const __m128 z2x3 = _mm_shuffle_ps(t[2], xy23, _MM_SHUFFLE(2,2,2,2));
+			const __m128 y3z3 = _mm_shuffle_ps(xy23, t[2], _MM_SHUFFLE(3,3,3,3));
+			float* dst = out[i].s;
+			_mm_storeu_ps(dst, _mm_shuffle_ps(xy01, z0x1, _MM_SHUFFLE(2,0,1,0)));
+			_mm_storeu_ps(dst+4, _mm_shuffle_ps(y1z1, xy23, _MM_SHUFFLE(1,0,2,0)));
+			_mm_storeu_ps(dst+8, _mm_shuffle_ps(z2x3, y3z3, _MM_SHUFFLE(2,0,2,0)));
+		}
+	}
+	#endif
+	for (; i < n; i++) out[i] = m33_apply((union m33*)m, in[i]);
+}
 
 union ipair {
 	struct { int a,b; };
@@ -192,64 +576,387 @@ static inline void ipair_lookup(const int** out_begin, const int** out_end, unio
 	if (out_end) *out_end = end;
 }
 
+/* mesh data of an outline; read-only once outline_prep() is done, so any
+ * number of instances and threads can share one. Per-draw state lives in
+ * struct outline_scratch */
 struct outline {
+	/* outlines made by outline_create_*() are freed when the last
+	 * outline_release() drops this to zero */
+	SDL_atomic_t refcount;
+	/* owns every array below once outline_prep() is done */
+	struct arena arena;
+
 	// specified
 	int n_vertices;
 	union v3* vertices;
 
 	int n_polygons;
-	int* polygon_materials;
+	int* polygon_materials; // 0 to n_materials-1
 	union ipair* polygon_lookup;
 	int* polygon_vertex_indices;
 
 	// derived
+	int n_materials;
 	union v3* polygon_normals;
+	/* polygon_normals as structure-of-arrays, for the classification
+	 * kernel */
+	float* polygon_normals_x;
+	float* polygon_normals_y;
+	float* polygon_normals_z;
 	int n_edges;
 	union ipair* edge_vertex_pairs;
 	union ipair* edge_polygon_pairs;
 	union ipair* vertex_edge_lookup;
 	int* vertex_edges;
+	/* half-edge i runs from polygon_vertex_indices[i] to the next vertex
+	 * of the same polygon; twin is -1 on mesh boundaries */
+	int n_halfedges;
+	int* halfedge_next;
+	int* halfedge_twin;
+	int* halfedge_polygon;
+	int* halfedge_edge;
+	union ipair* edge_halfedge_pairs;
+	/* polygons clustered by normal direction; a quadtree per cube map face,
+	 * where level l has 6*4^l nodes (see normal_cone_index()). Leaves are
+	 * at normal_cone_leaf_level, and their polygons are in
+	 * normal_bin_polygons. Each node has a cone bounding the normals below
+	 * it; normal_cone_sins holds the sine of the cone half-angle, 2 if it
+	 * is 90 degrees or more, or -1 if there are no polygons below it */
+	int normal_cone_leaf_level;
+	int n_normal_cones;
+	union v3* normal_cone_axes;
+	float* normal_cone_sins;
+	union ipair* normal_bin_lookup;
+	int* normal_bin_polygons;
+
+	// level of detail
+	/* next coarser level (see outline_prep_lods()), or NULL; owned by this
+	 * outline. lod_error bounds how far a vertex of this level has moved
+	 * from the finest level, in model units */
+	struct outline* lod;
+	float lod_error;
+};
 
-	// temporary
+/* per-draw state of an outline; outline_extract() only writes to this, so
+ * one outline can be extracted on several threads at once, given one
+ * scratch per thread. Nothing is kept between draws unless incremental mode
+ * is on, so a per-thread scratch serves any number of instances; an
+ * incremental instance needs a scratch of its own */
+struct outline_scratch {
+	/* the outline the scratch was made for, which sizes the arrays; its
+	 * coarser levels fit too. lod is the level of the last draw */
+	const struct outline* outline;
+	const struct outline* lod;
 	int* polygon_flags;
-	int* edge_flags;
+	int* halfedge_flags;
+	/* outline half-edges of the current draw, grouped by material */
+	int* contour_halfedges;
+	int* contour_halfedges_tmp;
+	union ipair* material_contour_lookup;
+	/* incremental mode (see outline_set_incremental()); polygon_flags, the
+	 * normal cone states and the set of outline half-edges are kept between
+	 * draws. contour_set is unordered, halfedge_contour_slots[h] is the
+	 * position of h in it or -1. Allocated on the first incremental draw */
+	int incremental;
+	int incremental_valid;
+	/* bumped whenever the set of outline half-edges may have changed */
+	int contour_version;
+	int* normal_cone_states;
+	int n_contour_set;
+	int* contour_set;
+	int* halfedge_contour_slots;
+	/* vertices transformed by tx; tx_vertices[i] is valid when
+	 * tx_vertex_generations[i] == tx_generation. The generation is bumped
+	 * when the transform changes, so consecutive draws with the same
+	 * transform share transformed vertices */
+	union m33 tx;
+	int tx_generation;
+	int* tx_vertex_generations;
+	union v3* tx_vertices;
+};
+
+struct outline_contour_island {
+	int material;
+	int winding; // NVG_CW or NVG_CCW
+	int offset; // first point
+	int length; // number of points
+};
+
+/* outlines as extracted by outline_extract(); islands are grouped by
+ * material in ascending order, and each island is a closed loop of points
+ * (x,y pairs) */
+struct outline_contours {
+	int n_islands;
+	int islands_cap;
+	struct outline_contour_island* islands;
+	int n_points;
+	int points_cap;
+	float* points;
+	/* mesh vertex of every point */
+	int* point_vertices;
+
+	/* path cache; what the points were made from, so the next
+	 * outline_extract() can keep or re-project them (see
+	 * outline_contours_set_tolerance()) */
+	float tolerance_pixels;
+	float tolerance_radians;
+	int cache_valid;
+	const struct outline* cache_lod;
+	const struct outline_scratch* cache_scratch;
+	int cache_contour_version;
+	union m33 cache_tx; // what the points were last projected with
+	union v3 cache_found_view; // what the outline was last found for
+	float cache_radius; // largest distance of a point's vertex from the origin
+};
+
+/* half-edge as emitted by outline_prep(); vertex_pair is ordered so that
+ * a<b, and tag is (halfedge_index<<1) | (1 if the half-edge's polygon is on
+ * the right side of the edge) */
+struct edge_record {
+	union ipair vertex_pair;
+	int tag;
+};
+
+/* slack for rounding errors in the normal cone tests */
+#define NORMAL_CONE_EPSILON (1e-5f)
+/* leaf level is picked so leaves hold about this many polygons */
+#define NORMAL_CONE_LEAF_POLYGONS (32)
+#define NORMAL_CONE_MAX_LEAF_LEVEL (7)
+
+static inline int normal_cone_index(int level, int face, int x, int y)
+{
+	const int resolution = 1 << level;
+	return 2*((1 << (2*level)) - 1) + (face*resolution + x)*resolution + y;
+}
+
+/* cube map cell of a normal direction at 2^level × 2^level cells per face;
+ * returns (face*2^level + x)*2^level + y */
+static int normal_bin(union v3 n, int level)
+{
+	const int resolution = 1 << level;
+	int axis = 0;
+	for (int i = 1; i < 3; i++) if (fabsf(n.s[i]) > fabsf(n.s[axis])) axis = i;
+	const float major = n.s[axis];
+	const int face = axis*2 + (major < 0.0f ? 1 : 0);
+	int cell[2];
+	for (int k = 0; k < 2; k++) {
+		float t = n.s[(axis+1+k)%3] / fabsf(major);
+		if (!(t >= -1.0f && t <= 1.0f)) t = 0.0f; /* also catches NaN */
+		int c = (int)((t*0.5f + 0.5f) * resolution);
+		if (c >= resolution) c = resolution-1;
+		cell[k] = c;
+	}
+	return (face*resolution + cell[0])*resolution + cell[1];
+}
+
+/* places every array of o in a, in a fixed order with the specified arrays
+ * first; all counts must be set (zero for ones not known yet) */
+static void outline__layout(struct outline* o, struct arena* a)
+{
+	const int n_normal_bins = 6 << (2*o->normal_cone_leaf_level);
+	o->vertices = arena_alloc(a, o->n_vertices, sizeof *o->vertices);
+	o->polygon_materials = arena_alloc(a, o->n_polygons, sizeof *o->polygon_materials);
+	o->polygon_lookup = arena_alloc(a, o->n_polygons, sizeof *o->polygon_lookup);
+	o->polygon_vertex_indices = arena_alloc(a, o->n_halfedges, sizeof *o->polygon_vertex_indices);
+	o->polygon_normals = arena_alloc(a, o->n_polygons, sizeof *o->polygon_normals);
+	o->polygon_normals_x = arena_alloc(a, o->n_polygons, sizeof *o->polygon_normals_x);
+	o->polygon_normals_y = arena_alloc(a, o->n_polygons, sizeof *o->polygon_normals_y);
+	o->polygon_normals_z = arena_alloc(a, o->n_polygons, sizeof *o->polygon_normals_z);
+	o->edge_vertex_pairs = arena_alloc(a, o->n_edges, sizeof *o->edge_vertex_pairs);
+	o->edge_polygon_pairs = arena_alloc(a, o->n_edges, sizeof *o->edge_polygon_pairs);
+	o->vertex_edge_lookup = arena_alloc(a, o->n_vertices, sizeof *o->vertex_edge_lookup);
+	o->vertex_edges = arena_alloc(a, 2*o->n_edges, sizeof *o->vertex_edges);
+	o->halfedge_next = arena_alloc(a, o->n_halfedges, sizeof *o->halfedge_next);
+	o->halfedge_twin = arena_alloc(a, o->n_halfedges, sizeof *o->halfedge_twin);
+	o->halfedge_polygon = arena_alloc(a, o->n_halfedges, sizeof *o->halfedge_polygon);
+	o->halfedge_edge = arena_alloc(a, o->n_halfedges, sizeof *o->halfedge_edge);
+	o->edge_halfedge_pairs = arena_alloc(a, o->n_edges, sizeof *o->edge_halfedge_pairs);
+	o->normal_cone_axes = arena_alloc(a, o->n_normal_cones, sizeof *o->normal_cone_axes);
+	o->normal_cone_sins = arena_alloc(a, o->n_normal_cones, sizeof *o->normal_cone_sins);
+	o->normal_bin_lookup = arena_alloc(a, n_normal_bins, sizeof *o->normal_bin_lookup);
+	o->normal_bin_polygons = arena_alloc(a, o->n_polygons, sizeof *o->normal_bin_polygons);
+}
+
+/* allocates the "specified" arrays of an outline in a fresh arena, for the
+ * caller to fill in before outline_prep(). Polygons are stored back to
+ * back in polygon_vertex_indices, with at least 3 vertices and no vertex
+ * repeated consecutively */
+static void outline_alloc(struct outline* o, int n_vertices, int n_polygons, int n_polygon_vertex_indices)
+{
+	memset(o, 0, sizeof *o);
+	o->n_vertices = n_vertices;
+	o->n_polygons = n_polygons;
+	o->n_halfedges = n_polygon_vertex_indices;
+	struct arena measure = {0};
+	outline__layout(o, &measure);
+	arena_init(&o->arena, measure.used);
+	outline__layout(o, &o->arena);
+}
+
+/* outline_prep() splits its work into chunks and runs them on a pool, or
+ * inline without one. Every stage gives the same bytes for any number of
+ * chunks: sorts are stable, runs of edge records are never split, and
+ * float sums are done per node in polygon order */
+#define PREP_CHUNKS_PER_THREAD (4)
+/* bounds the per-chunk histograms of the counting sorts, which take
+ * chunks × n_vertices ints */
+#define PREP_MAX_SORT_CHUNKS (8)
+
+static inline int prep__chunk_begin(int n, int n_chunks, int chunk)
+{
+	return (int)(((long long)n * chunk) / n_chunks);
+}
+
+struct prep {
+	struct outline* o;
+	struct pool* pool;
+	int n_chunks;
+	/* counting sorts keyed by vertex index; sort_counts holds a histogram
+	 * per chunk, then the scatter offsets of each chunk */
+	int n_sort_chunks;
+	int* sort_counts;
+	int* sort_range_sums;
+	int sort_n;
+	int sort_k;
+	const struct edge_record* sort_src;
+	struct edge_record* sort_dst;
+	/* edge records; run_begins[c] is the first record of chunk c, moved
+	 * forward to a run start, and run_edges[c] the number of edges in
+	 * chunk c, then the index of its first edge */
+	struct edge_record* records;
+	int* run_begins;
+	int* run_edges;
+	/* leaf normal cone of every polygon, and polygon count of every node */
+	int* bins;
+	int* cone_counts;
 };
 
-static int edge_vertex_pair_compar(const void* vx, const void* vy)
+static void prep__run(struct prep* p, int n_jobs, void (*fn)(void* usr, int job_index, int thread_index))
 {
-	const union ipair* x = vx;
-	const union ipair* y = vy;
-	if (x->a != y->a) {
-		return x->a - y->a;
+	if (p->pool == NULL) {
+		for (int i = 0; i < n_jobs; i++) fn(p, i, 0);
 	} else {
-		return x->b - y->b;
+		pool_run(p->pool, n_jobs, fn, p);
 	}
 }
 
-/* calculates everything in the "derived" section of struct outline, from the
- * "specified" section, and also initializes "temporary" stuff */
-static void outline_prep(struct outline* o)
+static void prep__sort_range_sum_job(void* usr, int range, int thread_index)
 {
-	/* prep normals */
-	assert((o->polygon_normals = calloc(o->n_polygons, sizeof *o->polygon_normals)) != NULL);
-	const int n_polygons = o->n_polygons;
-	int n_max_edges = 0;
-	for (int i = 0; i < n_polygons; i++) {
-		int offset = o->polygon_lookup[i].offset;
-		int n_polygon_vertices = o->polygon_lookup[i].length;
-		assert(n_polygon_vertices >= 3);
-		union v3 v0 = o->vertices[o->polygon_vertex_indices[offset]];
-		union v3 v1 = o->vertices[o->polygon_vertex_indices[offset+1]];
-		union v3 v2 = o->vertices[o->polygon_vertex_indices[offset+n_polygon_vertices-1]];
-		o->polygon_normals[i] = v3_normalize(v3_cross_product(v3_sub(v1, v0), v3_sub(v2, v0)));
-		n_max_edges += n_polygon_vertices;
+	struct prep* p = usr;
+	const int n_keys = p->o->n_vertices;
+	const int begin = prep__chunk_begin(n_keys, p->n_sort_chunks, range);
+	const int end = prep__chunk_begin(n_keys, p->n_sort_chunks, range+1);
+	int sum = 0;
+	for (int chunk = 0; chunk < p->n_sort_chunks; chunk++) {
+		const int* counts = &p->sort_counts[(size_t)chunk * n_keys];
+		for (int key = begin; key < end; key++) sum += counts[key];
+	}
+	p->sort_range_sums[range] = sum;
+}
+
+/* key-major, then chunk order, so equal keys keep their input order */
+static void prep__sort_offsets_job(void* usr, int range, int thread_index)
+{
+	struct prep* p = usr;
+	const int n_keys = p->o->n_vertices;
+	const int begin = prep__chunk_begin(n_keys, p->n_sort_chunks, range);
+	const int end = prep__chunk_begin(n_keys, p->n_sort_chunks, range+1);
+	int offset = p->sort_range_sums[range];
+	for (int key = begin; key < end; key++) {
+		for (int chunk = 0; chunk < p->n_sort_chunks; chunk++) {
+			int* count = &p->sort_counts[(size_t)chunk * n_keys + key];
+			const int n = *count;
+			*count = offset;
+			offset += n;
+		}
+	}
+}
+
+/* stable counting sort of p->sort_n items by vertex index; histogram_fn
+ * counts the keys of a chunk, scatter_fn moves its items */
+static void prep__counting_sort(struct prep* p, int n, void (*histogram_fn)(void*, int, int), void (*scatter_fn)(void*, int, int))
+{
+	p->sort_n = n;
+	prep__run(p, p->n_sort_chunks, histogram_fn);
+	prep__run(p, p->n_sort_chunks, prep__sort_range_sum_job);
+	int sum = 0;
+	for (int range = 0; range < p->n_sort_chunks; range++) {
+		const int range_sum = p->sort_range_sums[range];
+		p->sort_range_sums[range] = sum;
+		sum += range_sum;
+	}
+	prep__run(p, p->n_sort_chunks, prep__sort_offsets_job);
+	prep__run(p, p->n_sort_chunks, scatter_fn);
+}
+
+static void prep__records_histogram_job(void* usr, int chunk, int thread_index)
+{
+	struct prep* p = usr;
+	int* counts = &p->sort_counts[(size_t)chunk * p->o->n_vertices];
+	memset(counts, 0, p->o->n_vertices * sizeof *counts);
+	const int end = prep__chunk_begin(p->sort_n, p->n_sort_chunks, chunk+1);
+	for (int i = prep__chunk_begin(p->sort_n, p->n_sort_chunks, chunk); i < end; i++) {
+		counts[p->sort_src[i].vertex_pair.i[p->sort_k]]++;
 	}
+}
+
+static void prep__records_scatter_job(void* usr, int chunk, int thread_index)
+{
+	struct prep* p = usr;
+	int* offsets = &p->sort_counts[(size_t)chunk * p->o->n_vertices];
+	const int end = prep__chunk_begin(p->sort_n, p->n_sort_chunks, chunk+1);
+	for (int i = prep__chunk_begin(p->sort_n, p->n_sort_chunks, chunk); i < end; i++) {
+		const struct edge_record* r = &p->sort_src[i];
+		p->sort_dst[offsets[r->vertex_pair.i[p->sort_k]]++] = *r;
+	}
+}
+
+/* vertex->edge lookup; a counting sort of the edge ends by vertex, edge
+ * order kept within each vertex */
+static void prep__vertex_edges_histogram_job(void* usr, int chunk, int thread_index)
+{
+	struct prep* p = usr;
+	const struct outline* o = p->o;
+	int* counts = &p->sort_counts[(size_t)chunk * o->n_vertices];
+	memset(counts, 0, o->n_vertices * sizeof *counts);
+	const int end = prep__chunk_begin(p->sort_n, p->n_sort_chunks, chunk+1);
+	for (int i = prep__chunk_begin(p->sort_n, p->n_sort_chunks, chunk); i < end; i++) {
+		for (int k = 0; k < 2; k++) counts[o->edge_vertex_pairs[i].i[k]]++;
+	}
+}
+
+static void prep__vertex_edges_scatter_job(void* usr, int chunk, int thread_index)
+{
+	struct prep* p = usr;
+	struct outline* o = p->o;
+	int* offsets = &p->sort_counts[(size_t)chunk * o->n_vertices];
+	const int end = prep__chunk_begin(p->sort_n, p->n_sort_chunks, chunk+1);
+	for (int i = prep__chunk_begin(p->sort_n, p->n_sort_chunks, chunk); i < end; i++) {
+		for (int k = 0; k < 2; k++) o->vertex_edges[offsets[o->edge_vertex_pairs[i].i[k]]++] = i;
+	}
+}
+
+/* after the scatter, the last chunk's offset of a vertex is the end of its
+ * range */
+static void prep__vertex_edge_lookup_job(void* usr, int chunk, int thread_index)
+{
+	struct prep* p = usr;
+	struct outline* o = p->o;
+	const int* ends = &p->sort_counts[(size_t)(p->n_sort_chunks-1) * o->n_vertices];
+	const int end = prep__chunk_begin(o->n_vertices, p->n_chunks, chunk+1);
+	for (int i = prep__chunk_begin(o->n_vertices, p->n_chunks, chunk); i < end; i++) {
+		const int offset = (i > 0) ? ends[i-1] : 0;
+		o->vertex_edge_lookup[i].offset = offset;
+		o->vertex_edge_lookup[i].length = ends[i] - offset;
+	}
+}
 
-	/* find all edge pairs; sort to eliminate duplicates; remaining are
-	 * unique edges */
-	assert((o->edge_vertex_pairs = calloc(n_max_edges, sizeof(*o->edge_vertex_pairs))) != NULL);
-	int edge_vertex_pair_index = 0;
-	for (int polygon_index = 0; polygon_index < n_polygons; polygon_index++) {
+static void prep__records_job(void* usr, int chunk, int thread_index)
+{
+	struct prep* p = usr;
+	const struct outline* o = p->o;
+	const int end = prep__chunk_begin(o->n_polygons, p->n_chunks, chunk+1);
+	for (int polygon_index = prep__chunk_begin(o->n_polygons, p->n_chunks, chunk); polygon_index < end; polygon_index++) {
 		int offset = o->polygon_lookup[polygon_index].offset;
 		int n_polygon_vertices = o->polygon_lookup[polygon_index].length;
 
@@ -257,511 +964,4129 @@ static void outline_prep(struct outline* o)
 		for (int j = offset; j < (offset+n_polygon_vertices); j++) {
 			int va = o->polygon_vertex_indices[prev];
 			int vb = o->polygon_vertex_indices[j];
+			const int halfedge_index = prev;
 			prev = j;
 
-			/* ensure va < vb (because edge (va,vb) === (vb,va)) */
+			/* ensure va < vb (because edge (va,vb) === (vb,va));
+			 * the polygon is right of the edge if it was already
+			 * ordered that way */
+			int is_right = 1;
 			if (va > vb) {
 				int tmp = va;
 				va = vb;
 				vb = tmp;
+				is_right = 0;
 			}
 
 			assert(va < vb);
-			assert(edge_vertex_pair_index < n_max_edges);
-			o->edge_vertex_pairs[edge_vertex_pair_index].a = va;
-			o->edge_vertex_pairs[edge_vertex_pair_index].b = vb;
-			edge_vertex_pair_index++;
-
+			struct edge_record* r = &p->records[halfedge_index];
+			r->vertex_pair.a = va;
+			r->vertex_pair.b = vb;
+			r->tag = (halfedge_index << 1) | is_right;
 		}
 	}
-	assert(edge_vertex_pair_index == n_max_edges);
-	qsort(o->edge_vertex_pairs, n_max_edges, sizeof(*o->edge_vertex_pairs), edge_vertex_pair_compar);
+}
+
+static inline int prep__same_edge_pair(const struct edge_record* a, const struct edge_record* b)
+{
+	return a->vertex_pair.a == b->vertex_pair.a && a->vertex_pair.b == b->vertex_pair.b;
+}
+
+/* a run normally holds one record per side; a record whose side is already
+ * taken (more than two polygons on an edge, or neighbours with opposite
+ * winding) starts another edge, so the mesh is treated as open there. Same
+ * rule as prep__edges_job() */
+static void prep__count_edges_job(void* usr, int chunk, int thread_index)
+{
+	struct prep* p = usr;
+	const struct edge_record* records = p->records;
+	const int begin = p->run_begins[chunk];
+	const int end = p->run_begins[chunk+1];
 	int n_edges = 0;
-	union ipair* prev = NULL;
-	union ipair* cur = o->edge_vertex_pairs;
-	union ipair* wr = o->edge_vertex_pairs;
-	for (int i = 0; i < n_max_edges; i++) {
-		if (prev == NULL || memcmp(prev, cur, sizeof *cur) != 0) {
-			if (wr != cur) {
-				memcpy(wr, cur, sizeof *cur);
-			}
+	int sides = 0;
+	for (int i = begin; i < end; i++) {
+		const int side_bit = 1 << (records[i].tag & 1);
+		if (i == begin || !prep__same_edge_pair(&records[i], &records[i-1]) || (sides & side_bit)) {
 			n_edges++;
-			wr++;
+			sides = 0;
 		}
-		prev = cur;
-		cur++;
+		sides |= side_bit;
 	}
-	assert(cur == (o->edge_vertex_pairs + n_max_edges));
-	assert(wr == (o->edge_vertex_pairs + n_edges));
-	o->n_edges = n_edges;
-
-	/* trim edge_vertex_pairs to actual size now we know it */
-	assert((o->edge_vertex_pairs = realloc(o->edge_vertex_pairs, n_edges*sizeof(*o->edge_vertex_pairs))) != NULL);
+	p->run_edges[chunk] = n_edges;
+}
 
-	/* calculate vertex->edge lookup */
-	assert((o->vertex_edge_lookup = calloc(o->n_vertices, sizeof *o->vertex_edge_lookup)) != NULL);
-	const int n_vertex_edges = 2*n_edges;
-	assert((o->vertex_edges = calloc(n_vertex_edges, sizeof *o->vertex_edges)) != NULL);
-	int vei = 0;
-	/* XXX O(n^2).. or O(n_vertices * n_edges) */
-	for (int i = 0; i < o->n_vertices; i++) {
-		const int vei_start = vei;
-		for (int j = 0; j < n_edges; j++) {
-			for (int k = 0; k < 2; k++) {
-				if (o->edge_vertex_pairs[j].i[k] != i) continue;
-				assert(vei < n_vertex_edges);
-				o->vertex_edges[vei++] = j;
-			}
+static void prep__edges_job(void* usr, int chunk, int thread_index)
+{
+	struct prep* p = usr;
+	struct outline* o = p->o;
+	const struct edge_record* records = p->records;
+	const int begin = p->run_begins[chunk];
+	const int end = p->run_begins[chunk+1];
+	int edge_index = p->run_edges[chunk] - 1;
+	for (int i = begin; i < end; i++) {
+		const struct edge_record* r = &records[i];
+		const int side = (r->tag & 1) ? 1 : 0;
+		if (i == begin || !prep__same_edge_pair(r, &records[i-1]) || o->edge_polygon_pairs[edge_index].i[side] != -1) {
+			edge_index++;
+			o->edge_vertex_pairs[edge_index] = r->vertex_pair;
+			o->edge_polygon_pairs[edge_index].left = -1;
+			o->edge_polygon_pairs[edge_index].right = -1;
+			o->edge_halfedge_pairs[edge_index].left = -1;
+			o->edge_halfedge_pairs[edge_index].right = -1;
 		}
-		o->vertex_edge_lookup[i].offset = vei_start;
-		o->vertex_edge_lookup[i].length = vei - vei_start;
-	}
-	assert(vei == n_vertex_edges);
-
-	/* calculate edge->polygon lookup */
-	assert((o->edge_polygon_pairs = calloc(n_edges, sizeof *o->edge_polygon_pairs)) != NULL);
-	for (int i = 0; i < n_edges; i++) {
-		o->edge_polygon_pairs[i].left = -1;
-		o->edge_polygon_pairs[i].right = -1;
-	}
-	/* for each polygon... */
-	for (int polygon_index = 0; polygon_index < n_polygons; polygon_index++) {
-		const int *pvi_begin, *pvi_end;
-		ipair_lookup(&pvi_begin, &pvi_end, o->polygon_lookup, polygon_index, o->polygon_vertex_indices);
-
-		const int* pvi1 = pvi_end-1;
-		/* for each polygon edge / vertex pair... */
-		for (const int* pvi2 = pvi_begin; pvi2 < pvi_end; pvi2++) {
-			/* find matching edge... */
-			const int *ve_begin, *ve_end;
-			ipair_lookup(&ve_begin, &ve_end, o->vertex_edge_lookup, *pvi1, o->vertex_edges);
-			for (const int* vei = ve_begin; vei < ve_end; vei++) {
-				union ipair* evps = &o->edge_vertex_pairs[*vei];
-				int pvi1_found_at = -1;
-				int pvi2_found_at = -1;
-				for (int j = 0; j < 2; j++) {
-					int edge_vertex_index = evps->i[j];
-					if (edge_vertex_index == *pvi1) {
-						pvi1_found_at = j;
-					} else if (edge_vertex_index == *pvi2) {
-						pvi2_found_at = j;
-					}
-				}
-				assert(pvi1_found_at != -1 || pvi2_found_at != 1);
-				if (pvi1_found_at == -1 || pvi2_found_at == -1) continue;
-
-				/* edge matches; write polygon index on proper
-				 * side of edge */
-				union ipair* epp = &o->edge_polygon_pairs[*vei];
-				if (pvi2_found_at > pvi1_found_at) {
-					assert(epp->right == -1);
-					epp->right = polygon_index;
-				} else {
-					assert(epp->left == -1);
-					epp->left = polygon_index;
-				}
-			}
 
-			pvi1 = pvi2;
+		/* write half-edge and polygon index on proper side of edge */
+		const int halfedge_index = r->tag >> 1;
+		union ipair* epp = &o->edge_polygon_pairs[edge_index];
+		union ipair* ehp = &o->edge_halfedge_pairs[edge_index];
+		assert(epp->i[side] == -1);
+		epp->i[side] = o->halfedge_polygon[halfedge_index];
+		ehp->i[side] = halfedge_index;
+		o->halfedge_edge[halfedge_index] = edge_index;
+
+		/* both sides known; link the twins */
+		if (ehp->left != -1 && ehp->right != -1) {
+			o->halfedge_twin[ehp->left] = ehp->right;
+			o->halfedge_twin[ehp->right] = ehp->left;
 		}
 	}
-
-	/* temporary stuff */
-	assert((o->polygon_flags = calloc(o->n_polygons, sizeof *o->polygon_flags)) != NULL);
-	assert((o->edge_flags = calloc(o->n_edges, sizeof *o->edge_flags)) != NULL);
+	assert(chunk+1 == p->n_chunks || edge_index+1 == p->run_edges[chunk+1]);
 }
 
-#define DRAW (1<<0)
-#define REVERSE (1<<1)
-#define VISITED (1<<2)
-
-
-static inline int outline__get_edge_vertex_index(struct outline* o, int edge_index, int vertex_index)
+/* normals, their SoA copy, leaf cone bins, and the half-edges of a chunk
+ * of polygons; half-edge i runs from slot i to the next slot of the same
+ * polygon */
+static void prep__polygons_job(void* usr, int chunk, int thread_index)
 {
-	return o->edge_vertex_pairs[edge_index].i[vertex_index ^ (o->edge_flags[edge_index] & REVERSE ? 1 : 0)];
-}
+	struct prep* p = usr;
+	struct outline* o = p->o;
+	const int end = prep__chunk_begin(o->n_polygons, p->n_chunks, chunk+1);
+	for (int i = prep__chunk_begin(o->n_polygons, p->n_chunks, chunk); i < end; i++) {
+		int offset = o->polygon_lookup[i].offset;
+		int n_polygon_vertices = o->polygon_lookup[i].length;
+		union v3 v0 = o->vertices[o->polygon_vertex_indices[offset]];
+		union v3 v1 = o->vertices[o->polygon_vertex_indices[offset+1]];
+		union v3 v2 = o->vertices[o->polygon_vertex_indices[offset+n_polygon_vertices-1]];
+		const union v3 n = v3_normalize(v3_cross_product(v3_sub(v1, v0), v3_sub(v2, v0)));
+		o->polygon_normals[i] = n;
+		o->polygon_normals_x[i] = n.x;
+		o->polygon_normals_y[i] = n.y;
+		o->polygon_normals_z[i] = n.z;
+		p->bins[i] = normal_bin(n, o->normal_cone_leaf_level);
 
-static inline union v3 outline__get_edge_vertex(struct outline* o, union m33* tx, int edge_index, int vertex_index)
-{
-	union v3 v = o->vertices[outline__get_edge_vertex_index(o, edge_index, vertex_index)];
-	v = m33_apply(tx, v);
-	return v;
+		int prev = offset + n_polygon_vertices - 1;
+		for (int j = offset; j < (offset+n_polygon_vertices); j++) {
+			o->halfedge_next[prev] = j;
+			o->halfedge_twin[prev] = -1;
+			o->halfedge_polygon[prev] = i;
+			prev = j;
+		}
+	}
 }
 
-int XXX_TODO_RESOLVE_MULTIPLE_EXITS = 0;
-static inline int outline__follow(struct outline* o, int edge_index)
+/* sums the normals of a chunk of leaves, in polygon order */
+static void prep__leaf_axes_job(void* usr, int chunk, int thread_index)
 {
-	int vi = outline__get_edge_vertex_index(o, edge_index, 1);
-
-	const int *ve_begin, *ve_end;
-	ipair_lookup(&ve_begin, &ve_end, o->vertex_edge_lookup, vi, o->vertex_edges);
-	int n_exits_found = 0;
-	int found_edge;
-	for (const int* vei = ve_begin; vei < ve_end; vei++) {
-		if (*vei == edge_index) continue;
-		if ((o->edge_flags[*vei] & DRAW) == 0) continue;
-		n_exits_found++;
-		found_edge = *vei;
+	struct prep* p = usr;
+	struct outline* o = p->o;
+	const int n_bins = 6 << (2*o->normal_cone_leaf_level);
+	const int first_leaf = normal_cone_index(o->normal_cone_leaf_level, 0, 0, 0);
+	const int bin_end = prep__chunk_begin(n_bins, p->n_chunks, chunk+1);
+	for (int bin = prep__chunk_begin(n_bins, p->n_chunks, chunk); bin < bin_end; bin++) {
+		const int node = first_leaf + bin;
+		const int *begin, *end;
+		ipair_lookup(&begin, &end, o->normal_bin_lookup, bin, o->normal_bin_polygons);
+		for (const int* it = begin; it < end; it++) {
+			for (int k = 0; k < 3; k++) o->normal_cone_axes[node].s[k] += o->polygon_normals[*it].s[k];
+		}
+		p->cone_counts[node] = end - begin;
 	}
+}
 
-	assert(n_exits_found > 0);
-
-	if (n_exits_found == 1) {
-		return found_edge;
-	} else {
-		XXX_TODO_RESOLVE_MULTIPLE_EXITS = 1;
-		assert(0);
-		// TODO
-		return -1;
+/* leaf half-angles are the widest normal seen from the axis */
+static void prep__leaf_angles_job(void* usr, int chunk, int thread_index)
+{
+	struct prep* p = usr;
+	struct outline* o = p->o;
+	const int n_bins = 6 << (2*o->normal_cone_leaf_level);
+	const int first_leaf = normal_cone_index(o->normal_cone_leaf_level, 0, 0, 0);
+	const int bin_end = prep__chunk_begin(n_bins, p->n_chunks, chunk+1);
+	for (int bin = prep__chunk_begin(n_bins, p->n_chunks, chunk); bin < bin_end; bin++) {
+		const int node = first_leaf + bin;
+		if (p->cone_counts[node] == 0 || o->normal_cone_sins[node] > 1.0f) continue;
+		float min_dot = o->normal_cone_sins[node];
+		const int *begin, *end;
+		ipair_lookup(&begin, &end, o->normal_bin_lookup, bin, o->normal_bin_polygons);
+		for (const int* it = begin; it < end; it++) {
+			const float d = v3_dot(o->normal_cone_axes[node], o->polygon_normals[*it]);
+			if (!(d >= min_dot)) min_dot = d; /* also catches NaN */
+		}
+		o->normal_cone_sins[node] = (min_dot > 0.0f) ? sqrtf(1.0f - min_dot*min_dot) + NORMAL_CONE_EPSILON : 2.0f;
 	}
 }
 
-static int outline_draw(struct outline* o, NVGcontext* vg, union m33* tx, int draw_material)
+/* calculates everything in the "derived" section of struct outline, from the
+ * "specified" section (allocated with outline_alloc()), using the threads
+ * of pool (NULL runs everything on the calling thread; must not be called
+ * from a job of the same pool). The result is the same for any pool size.
+ * The arena is grown once, to a size found from counts gathered up front
+ * (the number of edges needs the sorted edge records); the specified
+ * arrays come first in the layout, so they stay where they are relative to
+ * the arena */
+static void outline_prep_parallel(struct outline* o, struct pool* pool)
 {
-	union v3 view = m33_get_view_v3(tx);
-
-	/* tag visible polygons; they both have to be facing the "camera"
-	 * (according to tx), and the polygon material has to match
-	 * draw_material */
 	const int n_polygons = o->n_polygons;
-	int n_tags = 0;
+	int n_halfedges = 0;
+	o->n_materials = 0;
 	for (int i = 0; i < n_polygons; i++) {
-		int flags = 0;
-		if (o->polygon_materials[i] == draw_material) {
-			if (v3_dot(view, o->polygon_normals[i]) > 0.0f) {
-				flags |= DRAW;
-				n_tags++;
-			}
-		}
-		o->polygon_flags[i] = flags;
+		assert(o->polygon_materials[i] >= 0);
+		if (o->polygon_materials[i] >= o->n_materials) o->n_materials = o->polygon_materials[i] + 1;
+		assert(o->polygon_lookup[i].length >= 3);
+		assert(o->polygon_lookup[i].offset == n_halfedges);
+		n_halfedges += o->polygon_lookup[i].length;
 	}
+	assert(n_halfedges == o->n_halfedges);
 
-	if (n_tags == 0) return 0; /* nothing to draw */
-
-	const int n_edges = o->n_edges;
-	n_tags = 0;
-	for (int i = 0; i < n_edges; i++) {
-		union ipair epp = o->edge_polygon_pairs[i];
-
-		int draw_left = epp.left != -1 && (o->polygon_flags[epp.left] & DRAW);
-		int draw_right = epp.right != -1 && (o->polygon_flags[epp.right] & DRAW);
-		int flags = 0;
-		if (draw_left != draw_right) {
-			flags |= DRAW;
-			if (draw_left) flags |= REVERSE;
-			n_tags++;
+	{
+		int leaf_level = 0;
+		while (leaf_level < NORMAL_CONE_MAX_LEAF_LEVEL && 6*(1 << (2*leaf_level))*NORMAL_CONE_LEAF_POLYGONS < n_polygons) {
+			leaf_level++;
 		}
-		o->edge_flags[i] = flags;
+		o->normal_cone_leaf_level = leaf_level;
+		o->n_normal_cones = normal_cone_index(leaf_level+1, 0, 0, 0);
 	}
-	assert(n_tags > 0);
-
-	nvgBeginPath(vg);
-
-	int n_islands = 0;
-	for (int i = 0; i < n_edges; i++) {
-		{
-			int f = o->edge_flags[i];
-			if ((f & DRAW) == 0) continue;
-			if (f & VISITED) continue;
-		}
-
-		float area = 0.0f;
-		const int first_edge_index = i;
-		int edge_index = first_edge_index;
-		union v3 prev_vertex = outline__get_edge_vertex(o, tx, edge_index, 0);
-		nvgMoveTo(vg, prev_vertex.x, prev_vertex.y);
-		do {
-			int* edge_flags = &o->edge_flags[edge_index];
-			assert((*edge_flags & VISITED) == 0);
-			*edge_flags |= VISITED;
-
-			union v3 vertex = outline__get_edge_vertex(o, tx, edge_index, 1);
-			nvgLineTo(vg, vertex.x, vertex.y);
 
-			area += (vertex.x - prev_vertex.x) * (vertex.y + prev_vertex.y);
-			prev_vertex = vertex;
-
-			edge_index = outline__follow(o, edge_index);
-		} while (edge_index != first_edge_index);
-
-		nvgClosePath(vg);
-		nvgPathWinding(vg, area > 0 ? NVG_CW : NVG_CCW);
+	struct prep p = {
+		.o = o,
+		.pool = pool,
+		.n_chunks = pool ? PREP_CHUNKS_PER_THREAD * pool->n_threads : 1,
+		.n_sort_chunks = pool ? pool->n_threads : 1,
+	};
+	if (p.n_sort_chunks > PREP_MAX_SORT_CHUNKS) p.n_sort_chunks = PREP_MAX_SORT_CHUNKS;
+	p.sort_counts = xcalloc((size_t)p.n_sort_chunks * o->n_vertices, sizeof *p.sort_counts);
+	p.sort_range_sums = xcalloc(p.n_sort_chunks, sizeof *p.sort_range_sums);
+
+	/* find all edge pairs; radix sort them so duplicates become adjacent;
+	 * each run of equal pairs is a unique edge, and the records in the run
+	 * tell which polygons are on either side of it */
+	p.records = xcalloc(n_halfedges, sizeof *p.records);
+	{
+		struct edge_record* records_tmp = xcalloc(n_halfedges, sizeof *records_tmp);
+		prep__run(&p, p.n_chunks, prep__records_job);
+		/* LSD radix sort where the radix is the vertex count */
+		p.sort_k = 1;
+		p.sort_src = p.records;
+		p.sort_dst = records_tmp;
+		prep__counting_sort(&p, n_halfedges, prep__records_histogram_job, prep__records_scatter_job);
+		p.sort_k = 0;
+		p.sort_src = records_tmp;
+		p.sort_dst = p.records;
+		prep__counting_sort(&p, n_halfedges, prep__records_histogram_job, prep__records_scatter_job);
+		free(records_tmp);
+	}
 
-		n_islands++;
+	p.run_begins = xcalloc(p.n_chunks+1, sizeof *p.run_begins);
+	p.run_edges = xcalloc(p.n_chunks, sizeof *p.run_edges);
+	for (int chunk = 1; chunk <= p.n_chunks; chunk++) {
+		int begin = prep__chunk_begin(n_halfedges, p.n_chunks, chunk);
+		if (begin < p.run_begins[chunk-1]) begin = p.run_begins[chunk-1];
+		while (begin > 0 && begin < n_halfedges && prep__same_edge_pair(&p.records[begin], &p.records[begin-1])) begin++;
+		p.run_begins[chunk] = begin;
+	}
+	prep__run(&p, p.n_chunks, prep__count_edges_job);
+	int n_edges = 0;
+	for (int chunk = 0; chunk < p.n_chunks; chunk++) {
+		const int chunk_edges = p.run_edges[chunk];
+		p.run_edges[chunk] = n_edges;
+		n_edges += chunk_edges;
 	}
+	o->n_edges = n_edges;
 
-	return 1;
-}
+	/* all counts known; grow the arena to fit the derived arrays */
+	{
+		struct arena measure = {0};
+		outline__layout(o, &measure);
+		arena_grow(&o->arena, measure.used);
+		arena_reset(&o->arena);
+		outline__layout(o, &o->arena);
+	}
 
-static void outline_init_hat(struct outline* o)
+	p.bins = xcalloc(n_polygons, sizeof *p.bins);
+	prep__run(&p, p.n_chunks, prep__polygons_job);
+	prep__run(&p, p.n_chunks, prep__edges_job);
+	free(p.records);
+	free(p.run_begins);
+	free(p.run_edges);
+
+	p.sort_k = 0;
+	prep__counting_sort(&p, n_edges, prep__vertex_edges_histogram_job, prep__vertex_edges_scatter_job);
+	prep__run(&p, p.n_chunks, prep__vertex_edge_lookup_job);
+	free(p.sort_counts);
+	free(p.sort_range_sums);
+
+	/* cluster polygons by normal direction, and find a cone around the
+	 * normals of every quadtree node */
+	{
+		const int leaf_level = o->normal_cone_leaf_level;
+		const int n_bins = 6 << (2*leaf_level);
+		const int n_cones = o->n_normal_cones;
+		const int* bins = p.bins;
+		int* counts = xcalloc(n_cones, sizeof *counts);
+		p.cone_counts = counts;
+
+		for (int i = 0; i < n_polygons; i++) o->normal_bin_lookup[bins[i]].length++;
+		int offset = 0;
+		for (int i = 0; i < n_bins; i++) {
+			o->normal_bin_lookup[i].offset = offset;
+			offset += o->normal_bin_lookup[i].length;
+			o->normal_bin_lookup[i].length = 0;
+		}
+		for (int i = 0; i < n_polygons; i++) {
+			union ipair* lu = &o->normal_bin_lookup[bins[i]];
+			o->normal_bin_polygons[lu->offset + lu->length++] = i;
+		}
+
+		/* node axes are the normalized sums of the normals below them;
+		 * sum up the leaves, then the levels above */
+		prep__run(&p, p.n_chunks, prep__leaf_axes_job);
+		for (int level = leaf_level-1; level >= 0; level--) {
+			const int res = 1 << level;
+			for (int face = 0; face < 6; face++) for (int x = 0; x < res; x++) for (int y = 0; y < res; y++) {
+				const int node = normal_cone_index(level, face, x, y);
+				for (int i = 0; i < 4; i++) {
+					const int child = normal_cone_index(level+1, face, 2*x + (i>>1), 2*y + (i&1));
+					for (int k = 0; k < 3; k++) o->normal_cone_axes[node].s[k] += o->normal_cone_axes[child].s[k];
+					counts[node] += counts[child];
+				}
+			}
+		}
+		for (int node = 0; node < n_cones; node++) {
+			union v3* axis = &o->normal_cone_axes[node];
+			if (counts[node] == 0) {
+				o->normal_cone_sins[node] = -1.0f;
+			} else if (v3_length(*axis) > 1e-6f) {
+				*axis = v3_normalize(*axis);
+				o->normal_cone_sins[node] = 1.0f;
+			} else {
+				o->normal_cone_sins[node] = 2.0f;
+			}
+		}
+		prep__run(&p, p.n_chunks, prep__leaf_angles_job);
+
+		/* inner half-angles bound the child cones */
+		for (int level = leaf_level-1; level >= 0; level--) {
+			const int res = 1 << level;
+			for (int face = 0; face < 6; face++) for (int x = 0; x < res; x++) for (int y = 0; y < res; y++) {
+				const int node = normal_cone_index(level, face, x, y);
+				if (o->normal_cone_sins[node] < 0.0f || o->normal_cone_sins[node] > 1.0f) continue;
+				float angle = 0.0f;
+				for (int i = 0; i < 4; i++) {
+					const int child = normal_cone_index(level+1, face, 2*x + (i>>1), 2*y + (i&1));
+					const float child_sin = o->normal_cone_sins[child];
+					if (child_sin < 0.0f) continue;
+					if (child_sin > 1.0f) {
+						angle = NVG_PI;
+						break;
+					}
+					float d = v3_dot(o->normal_cone_axes[node], o->normal_cone_axes[child]);
+					if (d > 1.0f) d = 1.0f;
+					if (d < -1.0f) d = -1.0f;
+					const float a = acosf(d) + asinf(child_sin);
+					if (!(a <= angle)) angle = a; /* also catches NaN */
+				}
+				o->normal_cone_sins[node] = (angle < NVG_PI*0.5f) ? sinf(angle) + NORMAL_CONE_EPSILON : 2.0f;
+			}
+		}
+		free(counts);
+	}
+	free(p.bins);
+}
+
+static void outline_prep(struct outline* o)
 {
-	const float radius = 100.0f;
-	const int n_segments = 12;
-	const int n_strips = 32;
+	outline_prep_parallel(o, NULL);
+}
 
+static void outline_free(struct outline* o)
+{
+	if (o->lod != NULL) {
+		outline_free(o->lod);
+		free(o->lod);
+	}
+	arena_free(&o->arena);
 	memset(o, 0, sizeof *o);
+}
 
-	const int n_vertices = n_segments * n_strips + 1;
-	o->n_vertices = n_vertices;
-	assert((o->vertices = calloc(n_vertices, sizeof *o->vertices)) != NULL);
+static void outline_scratch_init(struct outline_scratch* s, const struct outline* o)
+{
+	memset(s, 0, sizeof *s);
+	s->outline = o;
+	s->polygon_flags = xcalloc(o->n_polygons, sizeof *s->polygon_flags);
+	s->halfedge_flags = xcalloc(o->n_halfedges, sizeof *s->halfedge_flags);
+	s->contour_halfedges = xcalloc(o->n_halfedges, sizeof *s->contour_halfedges);
+	s->contour_halfedges_tmp = xcalloc(o->n_halfedges, sizeof *s->contour_halfedges_tmp);
+	s->material_contour_lookup = xcalloc(o->n_materials, sizeof *s->material_contour_lookup);
+	s->tx_vertex_generations = xcalloc(o->n_vertices, sizeof *s->tx_vertex_generations);
+	s->tx_vertices = xcalloc(o->n_vertices, sizeof *s->tx_vertices);
+}
 
-	const int n_polygons = n_segments * n_strips;
-	o->n_polygons = n_polygons;
-	assert((o->polygon_materials = calloc(n_polygons, sizeof *o->polygon_materials)) != NULL);
-	assert((o->polygon_lookup = calloc(n_polygons, sizeof *o->polygon_lookup)) != NULL);
+static void outline_scratch_free(struct outline_scratch* s)
+{
+	free(s->polygon_flags);
+	free(s->halfedge_flags);
+	free(s->contour_halfedges);
+	free(s->contour_halfedges_tmp);
+	free(s->material_contour_lookup);
+	free(s->normal_cone_states);
+	free(s->contour_set);
+	free(s->halfedge_contour_slots);
+	free(s->tx_vertex_generations);
+	free(s->tx_vertices);
+	memset(s, 0, sizeof *s);
+}
 
-	const int n_polygon_vertex_indices = (4*(n_segments-1)*n_strips) + 3*n_strips;
-	assert((o->polygon_vertex_indices = calloc(n_polygon_vertex_indices, sizeof *o->polygon_vertex_indices)) != NULL);
+/* level of detail: outline_prep_lods() decimates a prepped outline into a
+ * chain of coarser outlines by half-edge collapses (u moves onto v, so
+ * every level uses a subset of the original vertices), cheapest first by
+ * quadric error. Vertices on a material boundary or a mesh border only
+ * slide along it, and corners where boundaries meet never move, so every
+ * level keeps the material regions of the original */
+/* each level has about this fraction of the polygons of the one before */
+#define LOD_POLYGON_RATIO (0.5f)
+#define LOD_MIN_POLYGONS (16)
+/* a collapse may turn a polygon normal by at most acos() of this */
+#define LOD_MIN_NORMAL_DOT (0.2f)
+/* weight of the planes through boundary edges, keeping boundaries in place */
+#define LOD_BOUNDARY_WEIGHT (10.0)
+/* outline_extract() picks the coarsest level whose lod_error is at most
+ * this many pixels at the scale of the transform */
+#define OUTLINE_LOD_PIXELS (1.0f)
+/* levels --convert stores in cache files, and the demo draws with */
+#define OUTLINE_LOD_LEVELS (4)
+
+struct lod_collapse {
+	double cost;
+	int u, v;
+};
 
-	int vi = 0;
+/* polygons around a vertex; polygons points into ring_buffer until it
+ * outgrows it (cap > 0 means it is owned). May hold dead polygons */
+struct lod_ring {
+	int* polygons;
+	int n;
+	int cap;
+};
+
+struct lod {
+	const struct outline* o;
+	/* working copy of the polygons; slots as in o, polygon_lengths[i] is
+	 * 0 once polygon i is gone */
+	int* polygon_vertex_indices;
+	int* polygon_lengths;
+	int n_alive_polygons;
+	struct lod_ring* rings;
+	int* ring_buffer;
+	/* error quadric of every vertex (a², ab, ac, ad, b², bc, bd, c², cd,
+	 * d²), and a bound on how far it has moved */
+	double* quadrics;
+	float* errors;
+	int* alive;
+	/* scratch of lod__can_collapse() */
+	int mark;
+	int* marks;
+	int* link_marks;
+	int* edge_counts;
+	int* edge_dirs;
+	int* edge_materials;
+	int n_neighbours;
+	int neighbours_cap;
+	int* neighbours;
+	/* collapse candidates, a binary min-heap; entries go stale as the mesh
+	 * changes, and are checked again when they come out */
+	int n_heap;
+	int heap_cap;
+	struct lod_collapse* heap;
+};
+
+static inline int lod__collapse_less(const struct lod_collapse* a, const struct lod_collapse* b)
+{
+	if (a->cost != b->cost) return a->cost < b->cost;
+	if (a->u != b->u) return a->u < b->u;
+	return a->v < b->v;
+}
+
+static void lod__heap_push(struct lod* l, struct lod_collapse c)
+{
+	if (l->n_heap == l->heap_cap) {
+		l->heap_cap = l->heap_cap ? 2*l->heap_cap : 1024;
+		l->heap = xrealloc(l->heap, l->heap_cap * sizeof *l->heap);
+	}
+	int i = l->n_heap++;
+	while (i > 0) {
+		const int parent = (i-1) / 2;
+		if (!lod__collapse_less(&c, &l->heap[parent])) break;
+		l->heap[i] = l->heap[parent];
+		i = parent;
+	}
+	l->heap[i] = c;
+}
+
+static struct lod_collapse lod__heap_pop(struct lod* l)
+{
+	assert(l->n_heap > 0);
+	const struct lod_collapse top = l->heap[0];
+	const struct lod_collapse last = l->heap[--l->n_heap];
+	int i = 0;
+	for (;;) {
+		int child = 2*i + 1;
+		if (child >= l->n_heap) break;
+		if (child+1 < l->n_heap && lod__collapse_less(&l->heap[child+1], &l->heap[child])) child++;
+		if (!lod__collapse_less(&l->heap[child], &last)) break;
+		l->heap[i] = l->heap[child];
+		i = child;
+	}
+	if (l->n_heap > 0) l->heap[i] = last;
+	return top;
+}
+
+static void lod__add_plane(double* q, union v3 n, double d, double weight)
+{
+	const double a = n.x, b = n.y, c = n.z;
+	q[0] += weight*a*a; q[1] += weight*a*b; q[2] += weight*a*c; q[3] += weight*a*d;
+	q[4] += weight*b*b; q[5] += weight*b*c; q[6] += weight*b*d;
+	q[7] += weight*c*c; q[8] += weight*c*d;
+	q[9] += weight*d*d;
+}
+
+/* error of moving u onto v */
+static double lod__cost(const struct lod* l, int u, int v)
+{
+	const double* qu = &l->quadrics[10*u];
+	const double* qv = &l->quadrics[10*v];
+	double q[10];
+	for (int k = 0; k < 10; k++) q[k] = qu[k] + qv[k];
+	const union v3 p = l->o->vertices[v];
+	const double x = p.x, y = p.y, z = p.z;
+	return q[0]*x*x + 2*q[1]*x*y + 2*q[2]*x*z + 2*q[3]*x
+		+ q[4]*y*y + 2*q[5]*y*z + 2*q[6]*y
+		+ q[7]*z*z + 2*q[8]*z
+		+ q[9];
+}
+
+static inline int* lod__polygon(const struct lod* l, int polygon_index)
+{
+	return &l->polygon_vertex_indices[l->o->polygon_lookup[polygon_index].offset];
+}
+
+static inline int lod__polygon_find(const struct lod* l, int polygon_index, int vertex_index)
+{
+	const int* p = lod__polygon(l, polygon_index);
+	const int n = l->polygon_lengths[polygon_index];
+	for (int i = 0; i < n; i++) if (p[i] == vertex_index) return i;
+	return -1;
+}
+
+/* Newell normal of a polygon with u moved onto v (twice its area long) */
+static union v3 lod__polygon_normal(const struct lod* l, int polygon_index, int u, int v)
+{
+	const int* p = lod__polygon(l, polygon_index);
+	const int n = l->polygon_lengths[polygon_index];
+	union v3 normal = {0};
+	for (int i = 0; i < n; i++) {
+		const int ia = (p[i] == u) ? v : p[i];
+		const int ib = (p[(i+1)%n] == u) ? v : p[(i+1)%n];
+		const union v3 a = l->o->vertices[ia];
+		const union v3 b = l->o->vertices[ib];
+		normal.x += (a.y - b.y) * (a.z + b.z);
+		normal.y += (a.z - b.z) * (a.x + b.x);
+		normal.z += (a.x - b.x) * (a.y + b.y);
+	}
+	return normal;
+}
+
+/* whether the edge from u to its neighbour w is a boundary edge; valid
+ * after lod__boundary_edges(u) */
+static inline int lod__is_boundary_edge(const struct lod* l, int w)
+{
+	return l->edge_counts[w] != 2 || l->edge_dirs[w] != 0 || l->edge_materials[w] == -1;
+}
+
+/* collects the neighbours of u into l->neighbours, and counts the boundary
+ * edges at u: edges without exactly one polygon on either side, or with
+ * different materials on either side. *uv_is_boundary tells if (u,v) is
+ * one of them */
+static int lod__boundary_edges(struct lod* l, int u, int v, int* uv_is_boundary)
+{
+	const int mark = ++l->mark;
+	l->n_neighbours = 0;
+	const struct lod_ring* ring = &l->rings[u];
+	for (int i = 0; i < ring->n; i++) {
+		const int polygon_index = ring->polygons[i];
+		const int n = l->polygon_lengths[polygon_index];
+		if (n == 0) continue;
+		const int* p = lod__polygon(l, polygon_index);
+		const int material = l->o->polygon_materials[polygon_index];
+		const int at = lod__polygon_find(l, polygon_index, u);
+		assert(at != -1);
+		for (int dir = -1; dir <= 1; dir += 2) {
+			const int w = p[(at + n + dir) % n];
+			if (l->marks[w] != mark) {
+				l->marks[w] = mark;
+				l->edge_counts[w] = 0;
+				l->edge_dirs[w] = 0;
+				l->edge_materials[w] = material;
+				if (l->n_neighbours == l->neighbours_cap) {
+					l->neighbours_cap = l->neighbours_cap ? 2*l->neighbours_cap : 64;
+					l->neighbours = xrealloc(l->neighbours, l->neighbours_cap * sizeof *l->neighbours);
+				}
+				l->neighbours[l->n_neighbours++] = w;
+			}
+			l->edge_counts[w]++;
+			l->edge_dirs[w] += dir;
+			if (l->edge_materials[w] != material) l->edge_materials[w] = -1;
+		}
+	}
+
+	int n_boundary = 0;
+	*uv_is_boundary = 0;
+	for (int i = 0; i < l->n_neighbours; i++) {
+		const int w = l->neighbours[i];
+		const int is_boundary = lod__is_boundary_edge(l, w);
+		n_boundary += is_boundary;
+		if (w == v) *uv_is_boundary = is_boundary;
+	}
+	return n_boundary;
+}
+
+/* whether u can move onto v without changing material regions or the
+ * topology, and without folding polygons over */
+static int lod__can_collapse(struct lod* l, int u, int v)
+{
+	if (!l->alive[u] || !l->alive[v] || u == v) return 0;
+
+	int uv_is_boundary;
+	const int n_boundary = lod__boundary_edges(l, u, v, &uv_is_boundary);
+	if (n_boundary != 0 && !(n_boundary == 2 && uv_is_boundary)) return 0;
+
+	/* polygons with both u and v must have them side by side; polygons
+	 * that visit u or v twice are left alone */
+	int n_shared = 0;
+	const struct lod_ring* ring = &l->rings[u];
+	for (int i = 0; i < ring->n; i++) {
+		const int polygon_index = ring->polygons[i];
+		const int n = l->polygon_lengths[polygon_index];
+		const int* p = lod__polygon(l, polygon_index);
+		int n_u = 0, n_v = 0, at_u = -1, at_v = -1;
+		for (int k = 0; k < n; k++) {
+			if (p[k] == u) {
+				n_u++;
+				at_u = k;
+			} else if (p[k] == v) {
+				n_v++;
+				at_v = k;
+			}
+		}
+		if (n_u > 1 || n_v > 1) return 0;
+		if (n_v == 0) continue;
+		if ((at_u+1)%n != at_v && (at_v+1)%n != at_u) return 0;
+		n_shared++;
+	}
+	if (n_shared == 0) return 0;
+
+	/* link condition: a neighbour of both u and v must share a polygon
+	 * with them, or the collapse pinches the surface */
+	const int link_mark = l->mark;
+	const struct lod_ring* ring_v = &l->rings[v];
+	for (int i = 0; i < ring_v->n; i++) {
+		const int polygon_index = ring_v->polygons[i];
+		const int n = l->polygon_lengths[polygon_index];
+		const int* p = lod__polygon(l, polygon_index);
+		for (int k = 0; k < n; k++) {
+			if (p[k] != v) continue;
+			l->link_marks[p[(k+1)%n]] = link_mark;
+			l->link_marks[p[(k+n-1)%n]] = link_mark;
+		}
+	}
+	for (int i = 0; i < l->n_neighbours; i++) {
+		const int w = l->neighbours[i];
+		if (w == v || l->link_marks[w] != link_mark) continue;
+		int found = 0;
+		for (int j = 0; j < ring->n && !found; j++) {
+			const int polygon_index = ring->polygons[j];
+			if (l->polygon_lengths[polygon_index] == 0) continue;
+			found = lod__polygon_find(l, polygon_index, v) != -1 && lod__polygon_find(l, polygon_index, w) != -1;
+		}
+		if (!found) return 0;
+	}
+
+	for (int i = 0; i < ring->n; i++) {
+		const int polygon_index = ring->polygons[i];
+		const int n = l->polygon_lengths[polygon_index];
+		if (n == 0) continue;
+		if (n == 3 && lod__polygon_find(l, polygon_index, v) != -1) continue; /* goes away */
+		const union v3 before = lod__polygon_normal(l, polygon_index, -1, -1);
+		const union v3 after = lod__polygon_normal(l, polygon_index, u, v);
+		if (!(v3_dot(before, after) > LOD_MIN_NORMAL_DOT * v3_length(before) * v3_length(after))) return 0;
+	}
+	return 1;
+}
+
+static void lod__ring_push(struct lod_ring* ring, int polygon_index)
+{
+	if (ring->cap == 0 || ring->n == ring->cap) {
+		const int cap = 2*ring->n + 4;
+		int* polygons = xcalloc(cap, sizeof *polygons);
+		memcpy(polygons, ring->polygons, ring->n * sizeof *polygons);
+		if (ring->cap > 0) free(ring->polygons);
+		ring->polygons = polygons;
+		ring->cap = cap;
+	}
+	ring->polygons[ring->n++] = polygon_index;
+}
+
+static void lod__push_candidates(struct lod* l, int v)
+{
+	const struct lod_ring* ring = &l->rings[v];
+	for (int i = 0; i < ring->n; i++) {
+		const int polygon_index = ring->polygons[i];
+		const int n = l->polygon_lengths[polygon_index];
+		const int* p = lod__polygon(l, polygon_index);
+		for (int k = 0; k < n; k++) {
+			if (p[k] != v) continue;
+			const int w = p[(k+1)%n];
+			lod__heap_push(l, (struct lod_collapse){.cost = lod__cost(l, v, w), .u = v, .v = w});
+			lod__heap_push(l, (struct lod_collapse){.cost = lod__cost(l, w, v), .u = w, .v = v});
+		}
+	}
+}
+
+static float lod__segment_distance(union v3 p, union v3 a, union v3 b)
+{
+	const union v3 ab = v3_sub(b, a);
+	const float ab2 = v3_dot(ab, ab);
+	float t = (ab2 > 0.0f) ? v3_dot(v3_sub(p, a), ab) / ab2 : 0.0f;
+	if (t < 0.0f) t = 0.0f;
+	if (t > 1.0f) t = 1.0f;
+	return v3_length(v3_sub(p, v3_add(a, v3_scale(ab, t))));
+}
+
+static void lod__collapse(struct lod* l, int u, int v)
+{
+	struct lod_ring* ring_u = &l->rings[u];
+	struct lod_ring* ring_v = &l->rings[v];
+
+	/* a vertex sliding along a boundary leaves the edge from v to its
+	 * other boundary neighbour in place of its two edges */
+	int boundary_neighbour = -1;
+	int uv_is_boundary;
+	if (lod__boundary_edges(l, u, v, &uv_is_boundary) > 0) {
+		for (int i = 0; i < l->n_neighbours; i++) {
+			const int w = l->neighbours[i];
+			if (w != v && lod__is_boundary_edge(l, w)) boundary_neighbour = w;
+		}
+	}
+	for (int i = 0; i < ring_u->n; i++) {
+		const int polygon_index = ring_u->polygons[i];
+		int n = l->polygon_lengths[polygon_index];
+		if (n == 0) continue;
+		int* p = lod__polygon(l, polygon_index);
+		const int at_u = lod__polygon_find(l, polygon_index, u);
+		if (lod__polygon_find(l, polygon_index, v) != -1) {
+			memmove(&p[at_u], &p[at_u+1], (n - at_u - 1) * sizeof *p);
+			n--;
+			if (n < 3) {
+				n = 0;
+				l->n_alive_polygons--;
+			}
+			l->polygon_lengths[polygon_index] = n;
+		} else {
+			p[at_u] = v;
+			lod__ring_push(ring_v, polygon_index);
+		}
+	}
+
+	/* error: how far u is from the surface (and boundary) that replaces
+	 * it, on top of how far u itself had moved */
+	const union v3 pu = l->o->vertices[u];
+	float distance = 0.0f;
+	for (int i = 0; i < ring_u->n; i++) {
+		const int polygon_index = ring_u->polygons[i];
+		if (l->polygon_lengths[polygon_index] == 0) continue;
+		const union v3 normal = lod__polygon_normal(l, polygon_index, -1, -1);
+		const float length = v3_length(normal);
+		if (!(length > 0.0f)) continue;
+		const union v3 p0 = l->o->vertices[lod__polygon(l, polygon_index)[0]];
+		const float d = fabsf(v3_dot(normal, v3_sub(pu, p0))) / length;
+		if (d > distance) distance = d;
+	}
+	if (boundary_neighbour != -1) {
+		const float d = lod__segment_distance(pu, l->o->vertices[v], l->o->vertices[boundary_neighbour]);
+		if (d > distance) distance = d;
+	}
+	const float error = l->errors[u] + distance;
+	if (error > l->errors[v]) l->errors[v] = error;
+
+	/* drop dead polygons from v's ring while at it */
+	int n_ring = 0;
+	for (int i = 0; i < ring_v->n; i++) {
+		if (l->polygon_lengths[ring_v->polygons[i]] > 0) ring_v->polygons[n_ring++] = ring_v->polygons[i];
+	}
+	ring_v->n = n_ring;
+	if (ring_u->cap > 0) free(ring_u->polygons);
+	memset(ring_u, 0, sizeof *ring_u);
+
+	for (int k = 0; k < 10; k++) l->quadrics[10*v+k] += l->quadrics[10*u+k];
+	l->alive[u] = 0;
+
+	lod__push_candidates(l, v);
+}
+
+/* the current polygons as a new prepped outline, keeping the vertices in
+ * use in their original order */
+static struct outline* lod__snapshot(const struct lod* l)
+{
+	const struct outline* o = l->o;
+	int* vertex_map = xcalloc(o->n_vertices, sizeof *vertex_map);
+	int n_polygons = 0;
+	int n_polygon_vertex_indices = 0;
+	for (int i = 0; i < o->n_polygons; i++) {
+		const int n = l->polygon_lengths[i];
+		if (n == 0) continue;
+		const int* p = lod__polygon(l, i);
+		for (int k = 0; k < n; k++) vertex_map[p[k]] = 1;
+		n_polygons++;
+		n_polygon_vertex_indices += n;
+	}
+	int n_vertices = 0;
+	float error = 0.0f;
+	for (int i = 0; i < o->n_vertices; i++) {
+		if (!vertex_map[i]) {
+			vertex_map[i] = -1;
+			continue;
+		}
+		if (l->errors[i] > error) error = l->errors[i];
+		vertex_map[i] = n_vertices++;
+	}
+
+	struct outline* lod = xcalloc(1, sizeof *lod);
+	outline_alloc(lod, n_vertices, n_polygons, n_polygon_vertex_indices);
+	for (int i = 0; i < o->n_vertices; i++) {
+		if (vertex_map[i] != -1) lod->vertices[vertex_map[i]] = o->vertices[i];
+	}
 	int pi = 0;
 	int pvi = 0;
-	int segment_offset = 0;
-	for (int i = 0; i < n_segments; i++) {
-		union v3 v;
-		float it = ((float)-i / (float)n_segments) * NVG_PI * 0.5f;
-		float r = cosf(it);
-		v.y = -sinf(it) * radius;
+	for (int i = 0; i < o->n_polygons; i++) {
+		const int n = l->polygon_lengths[i];
+		if (n == 0) continue;
+		const int* p = lod__polygon(l, i);
+		lod->polygon_materials[pi] = o->polygon_materials[i];
+		lod->polygon_lookup[pi].offset = pvi;
+		lod->polygon_lookup[pi].length = n;
+		for (int k = 0; k < n; k++) lod->polygon_vertex_indices[pvi++] = vertex_map[p[k]];
+		pi++;
+	}
+	free(vertex_map);
+	outline_prep(lod);
+	lod->lod_error = error;
+	return lod;
+}
 
-		const int polygon_material = (i == 1 || i == 4 || i > 6) ? 1 : 0;
-		const int is_top = (i == n_segments-1);
-		const int n_polygon_sides = is_top ? 3 : 4;
+/* builds up to n_levels coarser versions of a prepped (or loaded) outline,
+ * chained through o->lod; the chain is owned by o, and saved with it by
+ * outline_save(). Stops early when the mesh cannot be simplified further */
+static void outline_prep_lods(struct outline* o, int n_levels)
+{
+	assert(o->lod == NULL);
+	const int n_vertices = o->n_vertices;
+	const int n_polygons = o->n_polygons;
+
+	struct lod l = {.o = o, .n_alive_polygons = n_polygons};
+	l.polygon_vertex_indices = xcalloc(o->n_halfedges, sizeof *l.polygon_vertex_indices);
+	memcpy(l.polygon_vertex_indices, o->polygon_vertex_indices, o->n_halfedges * sizeof *l.polygon_vertex_indices);
+	l.polygon_lengths = xcalloc(n_polygons, sizeof *l.polygon_lengths);
+	for (int i = 0; i < n_polygons; i++) l.polygon_lengths[i] = o->polygon_lookup[i].length;
+
+	/* rings start out as the vertex->polygon CSR */
+	l.rings = xcalloc(n_vertices, sizeof *l.rings);
+	l.ring_buffer = xcalloc(o->n_halfedges, sizeof *l.ring_buffer);
+	for (int i = 0; i < o->n_halfedges; i++) l.rings[o->polygon_vertex_indices[i]].cap++;
+	int offset = 0;
+	for (int i = 0; i < n_vertices; i++) {
+		l.rings[i].polygons = &l.ring_buffer[offset];
+		offset += l.rings[i].cap;
+		l.rings[i].cap = 0;
+	}
+	for (int i = 0; i < o->n_halfedges; i++) {
+		struct lod_ring* ring = &l.rings[o->polygon_vertex_indices[i]];
+		ring->polygons[ring->n++] = o->halfedge_polygon[i];
+	}
+
+	/* quadrics: the area weighted planes of the polygons around a vertex,
+	 * plus planes through boundary edges, square to the polygon */
+	l.quadrics = xcalloc(10*(size_t)n_vertices, sizeof *l.quadrics);
+	for (int i = 0; i < n_polygons; i++) {
+		const union v3 normal = lod__polygon_normal(&l, i, -1, -1);
+		const float length = v3_length(normal);
+		if (!(length > 0.0f)) continue;
+		const union v3 n = v3_scale(normal, 1.0f / length);
+		const int* p = lod__polygon(&l, i);
+		const int n_polygon_vertices = l.polygon_lengths[i];
+		const double d = -v3_dot(n, o->vertices[p[0]]);
+		for (int k = 0; k < n_polygon_vertices; k++) lod__add_plane(&l.quadrics[10*p[k]], n, d, 0.5*length);
+	}
+	for (int h = 0; h < o->n_halfedges; h++) {
+		const int twin = o->halfedge_twin[h];
+		const int polygon_index = o->halfedge_polygon[h];
+		if (twin != -1 && o->polygon_materials[o->halfedge_polygon[twin]] == o->polygon_materials[polygon_index]) continue;
+		const int va = o->polygon_vertex_indices[h];
+		const int vb = o->polygon_vertex_indices[o->halfedge_next[h]];
+		const union v3 e = v3_sub(o->vertices[vb], o->vertices[va]);
+		const union v3 b = v3_cross_product(e, o->polygon_normals[polygon_index]);
+		const float length = v3_length(b);
+		if (!(length > 0.0f)) continue;
+		const union v3 n = v3_scale(b, 1.0f / length);
+		const double d = -v3_dot(n, o->vertices[va]);
+		const double weight = LOD_BOUNDARY_WEIGHT * v3_dot(e, e);
+		lod__add_plane(&l.quadrics[10*va], n, d, weight);
+		lod__add_plane(&l.quadrics[10*vb], n, d, weight);
+	}
+
+	l.errors = xcalloc(n_vertices, sizeof *l.errors);
+	l.alive = xcalloc(n_vertices, sizeof *l.alive);
+	for (int i = 0; i < n_vertices; i++) l.alive[i] = 1;
+	l.marks = xcalloc(n_vertices, sizeof *l.marks);
+	l.link_marks = xcalloc(n_vertices, sizeof *l.link_marks);
+	l.edge_counts = xcalloc(n_vertices, sizeof *l.edge_counts);
+	l.edge_dirs = xcalloc(n_vertices, sizeof *l.edge_dirs);
+	l.edge_materials = xcalloc(n_vertices, sizeof *l.edge_materials);
+
+	for (int i = 0; i < o->n_edges; i++) {
+		const union ipair e = o->edge_vertex_pairs[i];
+		lod__heap_push(&l, (struct lod_collapse){.cost = lod__cost(&l, e.a, e.b), .u = e.a, .v = e.b});
+		lod__heap_push(&l, (struct lod_collapse){.cost = lod__cost(&l, e.b, e.a), .u = e.b, .v = e.a});
+	}
+
+	struct outline* level = o;
+	int target = (int)(n_polygons * LOD_POLYGON_RATIO);
+	for (int i = 0; i < n_levels && target >= LOD_MIN_POLYGONS; ) {
+		if (l.n_heap > 0 && l.n_alive_polygons > target) {
+			const struct lod_collapse c = lod__heap_pop(&l);
+			if (!l.alive[c.u] || !l.alive[c.v]) continue;
+			/* stale cost; put it back in line */
+			const double cost = lod__cost(&l, c.u, c.v);
+			if (cost > c.cost) {
+				lod__heap_push(&l, (struct lod_collapse){.cost = cost, .u = c.u, .v = c.v});
+				continue;
+			}
+			if (!lod__can_collapse(&l, c.u, c.v)) continue;
+			lod__collapse(&l, c.u, c.v);
+			continue;
+		}
+		/* target reached, or nothing left to collapse; keep the level
+		 * only if it is a real step down */
+		if (l.n_alive_polygons > level->n_polygons * (1.0f + LOD_POLYGON_RATIO) * 0.5f) break;
+		level->lod = lod__snapshot(&l);
+		level = level->lod;
+		i++;
+		target = (int)(level->n_polygons * LOD_POLYGON_RATIO);
+		if (l.n_heap == 0) break;
+	}
+
+	for (int i = 0; i < n_vertices; i++) if (l.rings[i].cap > 0) free(l.rings[i].polygons);
+	free(l.rings);
+	free(l.ring_buffer);
+	free(l.polygon_vertex_indices);
+	free(l.polygon_lengths);
+	free(l.quadrics);
+	free(l.errors);
+	free(l.alive);
+	free(l.marks);
+	free(l.link_marks);
+	free(l.edge_counts);
+	free(l.edge_dirs);
+	free(l.edge_materials);
+	free(l.neighbours);
+	free(l.heap);
+}
+
+/* coarsest level of o that is within OUTLINE_LOD_PIXELS of the finest one
+ * at the scale of tx */
+static const struct outline* outline_select_lod(const struct outline* o, union m33* tx)
+{
+	const float scale = m33_get_projected_scale(tx);
+	while (o->lod != NULL && o->lod->lod_error * scale <= OUTLINE_LOD_PIXELS) o = o->lod;
+	return o;
+}
+
+#define DRAW (1<<0)
+#define VISITED (1<<1)
+
+
+static inline int outline__halfedge_vertex_index(const struct outline* o, int halfedge_index, int vertex_index)
+{
+	return o->polygon_vertex_indices[vertex_index ? o->halfedge_next[halfedge_index] : halfedge_index];
+}
+
+/* invalidates all transformed vertices */
+static void outline__bump_tx_generation(struct outline_scratch* s)
+{
+	if (s->tx_generation == INT_MAX) {
+		memset(s->tx_vertex_generations, 0, s->outline->n_vertices * sizeof *s->tx_vertex_generations);
+		s->tx_generation = 0;
+	}
+	s->tx_generation++;
+}
+
+static void outline__set_transform(const struct outline* o, struct outline_scratch* s, union m33* tx)
+{
+	if (s->tx_generation > 0 && memcmp(&s->tx, tx, sizeof s->tx) == 0) return;
+	s->tx = *tx;
+	outline__bump_tx_generation(s);
+}
+
+static inline union v3 outline__get_vertex(const struct outline* o, struct outline_scratch* s, int vertex_index)
+{
+	if (s->tx_vertex_generations[vertex_index] != s->tx_generation) {
+		s->tx_vertices[vertex_index] = m33_apply(&s->tx, o->vertices[vertex_index]);
+		s->tx_vertex_generations[vertex_index] = s->tx_generation;
+	}
+	return s->tx_vertices[vertex_index];
+}
+
+/* transforms the first vertices of the given half-edges, in batches of
+ * OUTLINE_TX_BATCH; an outline walk then finds every vertex transformed,
+ * as each of its half-edges starts where the one before it ends */
+#define OUTLINE_TX_BATCH (64)
+static void outline__transform_halfedge_vertices(const struct outline* o, struct outline_scratch* s, const int* halfedges, int n_halfedges)
+{
+	int indices[OUTLINE_TX_BATCH];
+	union v3 vertices[OUTLINE_TX_BATCH];
+	int n = 0;
+	for (int i = 0; i < n_halfedges; i++) {
+		const int vertex_index = o->polygon_vertex_indices[halfedges[i]];
+		if (s->tx_vertex_generations[vertex_index] == s->tx_generation) continue;
+		s->tx_vertex_generations[vertex_index] = s->tx_generation;
+		indices[n] = vertex_index;
+		vertices[n] = o->vertices[vertex_index];
+		n++;
+		if (n == OUTLINE_TX_BATCH) {
+			m33_apply_batch(&s->tx, vertices, vertices, n);
+			for (int k = 0; k < n; k++) s->tx_vertices[indices[k]] = vertices[k];
+			n = 0;
+		}
+	}
+	if (n > 0) {
+		m33_apply_batch(&s->tx, vertices, vertices, n);
+		for (int k = 0; k < n; k++) s->tx_vertices[indices[k]] = vertices[k];
+	}
+}
+
+static inline union v3 outline__get_halfedge_vertex(const struct outline* o, struct outline_scratch* s, int halfedge_index, int vertex_index)
+{
+	return outline__get_vertex(o, s, outline__halfedge_vertex_index(o, halfedge_index, vertex_index));
+}
+
+/* material of polygon if it is tagged DRAW, otherwise -1 */
+static inline int outline__polygon_region(const struct outline* o, struct outline_scratch* s, int polygon_index)
+{
+	if (polygon_index == -1 || (s->polygon_flags[polygon_index] & DRAW) == 0) return -1;
+	return o->polygon_materials[polygon_index];
+}
+
+/* finds the outline half-edge following halfedge_index by rotating around
+ * the vertex it points to: starting from the next half-edge in the same
+ * polygon, cross over to the twin's polygon for as long as it is drawn
+ * with the same material. The rotation visits the polygons around the
+ * vertex in angular order, so vertices where the outline touches itself
+ * resolve to the adjacent exit */
+static inline int outline__follow(const struct outline* o, struct outline_scratch* s, int halfedge_index, int material)
+{
+	const int first = o->halfedge_next[halfedge_index];
+	int h = first;
+	for (;;) {
+		const int twin = o->halfedge_twin[h];
+		if (twin == -1 || outline__polygon_region(o, s, o->halfedge_polygon[twin]) != material) {
+			return h;
+		}
+		h = o->halfedge_next[twin];
+		assert(h != first);
+	}
+}
+
+/* tags visible polygons with DRAW in polygon_flags; they both have to be
+ * facing the "camera" (view), and the polygon material has to match
+ * draw_material, unless it is negative. Returns the number of tagged
+ * polygons. The dot product is
+ * summed in the same order as v3_dot(), so all paths agree bit for bit */
+static int outline__classify_polygons(const struct outline* o, struct outline_scratch* s, union v3 view, int draw_material)
+{
+	const int n_polygons = o->n_polygons;
+	const float* nx = o->polygon_normals_x;
+	const float* ny = o->polygon_normals_y;
+	const float* nz = o->polygon_normals_z;
+	const int* materials = o->polygon_materials;
+	int* flags = s->polygon_flags;
+	int n_tags = 0;
+	int i = 0;
+
+	#if defined(__AVX2__)
+	{
+		const __m256 vx = _mm256_set1_ps(view.x);
+		const __m256 vy = _mm256_set1_ps(view.y);
+		const __m256 vz = _mm256_set1_ps(view.z);
+		const __m256i material = _mm256_set1_epi32(draw_material);
+		const __m256i any = _mm256_set1_epi32(draw_material < 0 ? -1 : 0);
+		const __m256i draw = _mm256_set1_epi32(DRAW);
+		__m256i count = _mm256_setzero_si256();
+		for (; i+8 <= n_polygons; i += 8) {
+			__m256 d = _mm256_add_ps(
+				_mm256_add_ps(
+					_mm256_mul_ps(vx, _mm256_loadu_ps(nx+i)),
+					_mm256_mul_ps(vy, _mm256_loadu_ps(ny+i))),
+				_mm256_mul_ps(vz, _mm256_loadu_ps(nz+i)));
+			__m256i facing = _mm256_castps_si256(_mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_GT_OQ));
+			__m256i match = _mm256_or_si256(any, _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(materials+i)), material));
+			__m256i mask = _mm256_and_si256(facing, match);
+			_mm256_storeu_si256((__m256i*)(flags+i), _mm256_and_si256(mask, draw));
+			count = _mm256_sub_epi32(count, mask);
+		}
+		int lanes[8];
+		_mm256_storeu_si256((__m256i*)lanes, count);
+		for (int k = 0; k < 8; k++) n_tags += lanes[k];
+	}
+	#endif
+
+	#if defined(__SSE2__)
+	{
+		const __m128 vx = _mm_set1_ps(view.x);
+		const __m128 vy = _mm_set1_ps(view.y);
+		const __m128 vz = _mm_set1_ps(view.z);
+		const __m128i material = _mm_set1_epi32(draw_material);
+		const __m128i any = _mm_set1_epi32(draw_material < 0 ? -1 : 0);
+		const __m128i draw = _mm_set1_epi32(DRAW);
+		__m128i count = _mm_setzero_si128();
+		for (; i+4 <= n_polygons; i += 4) {
+			__m128 d = _mm_add_ps(
+				_mm_add_ps(
+					_mm_mul_ps(vx, _mm_loadu_ps(nx+i)),
+					_mm_mul_ps(vy, _mm_loadu_ps(ny+i))),
+				_mm_mul_ps(vz, _mm_loadu_ps(nz+i)));
+			__m128i facing = _mm_castps_si128(_mm_cmpgt_ps(d, _mm_setzero_ps()));
+			__m128i match = _mm_or_si128(any, _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(materials+i)), material));
+			__m128i mask = _mm_and_si128(facing, match);
+			_mm_storeu_si128((__m128i*)(flags+i), _mm_and_si128(mask, draw));
+			count = _mm_sub_epi32(count, mask);
+		}
+		int lanes[4];
+		_mm_storeu_si128((__m128i*)lanes, count);
+		for (int k = 0; k < 4; k++) n_tags += lanes[k];
+	}
+	#endif
+
+	/* scalar fallback, and remainder of the SIMD loops */
+	for (; i < n_polygons; i++) {
+		int f = 0;
+		if ((draw_material < 0 || materials[i] == draw_material) && (view.x*nx[i] + view.y*ny[i] + view.z*nz[i]) > 0.0f) {
+			f = DRAW;
+			n_tags++;
+		}
+		flags[i] = f;
+	}
+
+	return n_tags;
+}
+
+/* finds outline half-edges by scanning every edge; an edge is on the outline
+ * of a material when exactly one of its sides is a tagged polygon of that
+ * material. Leaves them in contour_halfedges_tmp and returns the count */
+static int outline__find_contour_full(const struct outline* o, struct outline_scratch* s, union v3 view)
+{
+	s->contour_version++;
+	if (outline__classify_polygons(o, s, view, -1) == 0) return 0;
+
+	const int n_edges = o->n_edges;
+	int n_contour = 0;
+	for (int i = 0; i < n_edges; i++) {
+		const union ipair epp = o->edge_polygon_pairs[i];
+		int regions[2];
+		for (int k = 0; k < 2; k++) regions[k] = outline__polygon_region(o, s, epp.i[k]);
+		if (regions[0] == regions[1]) continue;
+		for (int k = 0; k < 2; k++) {
+			if (regions[k] == -1) continue;
+			s->contour_halfedges_tmp[n_contour++] = o->edge_halfedge_pairs[i].i[k];
+		}
+	}
+	return n_contour;
+}
+
+#define NORMAL_CONE_EMPTY (1)
+#define NORMAL_CONE_FRONT (2)
+#define NORMAL_CONE_BACK (3)
+#define NORMAL_CONE_MIXED (4)
+
+static inline int outline__normal_cone_state(const struct outline* o, int node, union v3 view, float view_length)
+{
+	const float s = o->normal_cone_sins[node];
+	if (s < 0.0f) return NORMAL_CONE_EMPTY;
+	if (s > 1.0f) return NORMAL_CONE_MIXED;
+	const float d = v3_dot(view, o->normal_cone_axes[node]);
+	const float m = view_length * s;
+	if (d > m) return NORMAL_CONE_FRONT;
+	if (d < -m) return NORMAL_CONE_BACK;
+	return NORMAL_CONE_MIXED;
+}
+
+/* adds/removes halfedge_index to/from contour_set depending on whether it
+ * is on an outline with the current polygon_flags */
+static inline void outline__update_contour_set(const struct outline* o, struct outline_scratch* s, int halfedge_index)
+{
+	const int region = outline__polygon_region(o, s, o->halfedge_polygon[halfedge_index]);
+	const int twin = o->halfedge_twin[halfedge_index];
+	const int twin_region = (twin == -1) ? -1 : outline__polygon_region(o, s, o->halfedge_polygon[twin]);
+	const int is_contour = (region != -1 && region != twin_region);
+	int* slot = &s->halfedge_contour_slots[halfedge_index];
+	if (is_contour && *slot == -1) {
+		*slot = s->n_contour_set;
+		s->contour_set[s->n_contour_set++] = halfedge_index;
+		s->contour_version++;
+	} else if (!is_contour && *slot != -1) {
+		const int last = s->contour_set[--s->n_contour_set];
+		s->contour_set[*slot] = last;
+		s->halfedge_contour_slots[last] = *slot;
+		*slot = -1;
+		s->contour_version++;
+	}
+}
+
+/* re-classifies the polygons below a normal cone quadtree node whose
+ * state changed, or is mixed. A node that was entirely front (or back)
+ * facing at the previous draw and is so now cannot contain polygons that
+ * changed facing, so its whole subtree is skipped with one dot product.
+ * Only the half-edges of polygons that flipped are re-evaluated */
+static void outline__update_normal_cone(const struct outline* o, struct outline_scratch* s, int level, int face, int x, int y, union v3 view, float view_length)
+{
+	const int node = normal_cone_index(level, face, x, y);
+	const int state = outline__normal_cone_state(o, node, view, view_length);
+	const int prev_state = s->normal_cone_states[node];
+	s->normal_cone_states[node] = state;
+	if (state == prev_state && state != NORMAL_CONE_MIXED) return;
+
+	if (level < o->normal_cone_leaf_level) {
+		for (int i = 0; i < 4; i++) {
+			outline__update_normal_cone(o, s, level+1, face, 2*x + (i>>1), 2*y + (i&1), view, view_length);
+		}
+		return;
+	}
+
+	const int resolution = 1 << level;
+	const int *begin, *end;
+	ipair_lookup(&begin, &end, o->normal_bin_lookup, (face*resolution + x)*resolution + y, o->normal_bin_polygons);
+	for (const int* p = begin; p < end; p++) {
+		const int polygon_index = *p;
+		const int facing = (view.x*o->polygon_normals_x[polygon_index] + view.y*o->polygon_normals_y[polygon_index] + view.z*o->polygon_normals_z[polygon_index]) > 0.0f;
+		if (facing == ((s->polygon_flags[polygon_index] & DRAW) != 0)) continue;
+		s->polygon_flags[polygon_index] ^= DRAW;
+
+		const int *pb, *pe;
+		ipair_lookup(&pb, &pe, o->polygon_lookup, polygon_index, o->polygon_vertex_indices);
+		for (int h = pb - o->polygon_vertex_indices; h < pe - o->polygon_vertex_indices; h++) {
+			outline__update_contour_set(o, s, h);
+			if (o->halfedge_twin[h] != -1) outline__update_contour_set(o, s, o->halfedge_twin[h]);
+		}
+	}
+}
+
+/* incremental version of outline__find_contour_full(); polygon_flags and
+ * contour_set are carried over from the previous draw, and updated by
+ * descending the normal cone quadtree into the nodes that may contain
+ * polygons that changed facing. The cost follows the size of the horizon
+ * band and of the change, not the size of the mesh */
+static int outline__find_contour_incremental(const struct outline* o, struct outline_scratch* s, union v3 view)
+{
+	const float view_length = v3_length(view);
+
+	if (!s->incremental_valid) {
+		if (s->contour_set == NULL) {
+			s->normal_cone_states = xcalloc(s->outline->n_normal_cones, sizeof *s->normal_cone_states);
+			s->contour_set = xcalloc(s->outline->n_halfedges, sizeof *s->contour_set);
+			s->halfedge_contour_slots = xcalloc(s->outline->n_halfedges, sizeof *s->halfedge_contour_slots);
+		}
+		outline__classify_polygons(o, s, view, -1);
+		s->contour_version++;
+		memset(s->halfedge_contour_slots, 0xff, o->n_halfedges * sizeof *s->halfedge_contour_slots);
+		s->n_contour_set = 0;
+		for (int i = 0; i < o->n_halfedges; i++) outline__update_contour_set(o, s, i);
+		for (int i = 0; i < o->n_normal_cones; i++) {
+			s->normal_cone_states[i] = outline__normal_cone_state(o, i, view, view_length);
+		}
+		s->incremental_valid = 1;
+		return s->n_contour_set;
+	}
+
+	for (int face = 0; face < 6; face++) {
+		outline__update_normal_cone(o, s, 0, face, 0, 0, view, view_length);
+	}
+
+	return s->n_contour_set;
+}
+
+/* enables/disables incremental outline updates; worthwhile when the
+ * transform changes a little between draws */
+static void outline_set_incremental(struct outline_scratch* s, int incremental)
+{
+	s->incremental = incremental;
+	s->incremental_valid = 0;
+}
+
+/* finds the outline half-edges for view and points *contour at them;
+ * returns their count */
+static int outline__find_contour(const struct outline* o, struct outline_scratch* s, union v3 view, const int** contour)
+{
+	/* what is kept between draws belongs to one level of detail */
+	if (o != s->lod) {
+		s->lod = o;
+		s->incremental_valid = 0;
+		outline__bump_tx_generation(s);
+	}
+	if (s->incremental) {
+		const int n_contour = outline__find_contour_incremental(o, s, view);
+		*contour = s->contour_set;
+		return n_contour;
+	} else {
+		*contour = s->contour_halfedges_tmp;
+		return outline__find_contour_full(o, s, view);
+	}
+}
+
+static void outline_contours__push_point(struct outline_contours* c, union v3 v, int vertex_index)
+{
+	if (c->n_points == c->points_cap) {
+		c->points_cap = c->points_cap ? 2*c->points_cap : 256;
+		c->points = xrealloc(c->points, 2*c->points_cap*sizeof *c->points);
+		c->point_vertices = xrealloc(c->point_vertices, c->points_cap*sizeof *c->point_vertices);
+	}
+	c->points[2*c->n_points] = v.x;
+	c->points[2*c->n_points+1] = v.y;
+	c->point_vertices[c->n_points] = vertex_index;
+	c->n_points++;
+}
+
+static struct outline_contour_island* outline_contours__push_island(struct outline_contours* c)
+{
+	if (c->n_islands == c->islands_cap) {
+		c->islands_cap = c->islands_cap ? 2*c->islands_cap : 16;
+		c->islands = xrealloc(c->islands, c->islands_cap*sizeof *c->islands);
+	}
+	return &c->islands[c->n_islands++];
+}
+
+static void outline_contours_free(struct outline_contours* c)
+{
+	free(c->islands);
+	free(c->points);
+	free(c->point_vertices);
+	memset(c, 0, sizeof *c);
+}
+
+/* walks the outline half-edges and stores them as transformed points in c */
+static void outline__walk_contour(const struct outline* o, struct outline_scratch* s, union m33* tx, const int* contour, int n_contour, struct outline_contours* c)
+{
+	c->n_islands = 0;
+	c->n_points = 0;
+	if (n_contour == 0) return; /* nothing to draw */
+
+	/* group outline half-edges by material (stable, so each material sees
+	 * them in the order they were found) */
+	const int n_materials = o->n_materials;
+	memset(s->material_contour_lookup, 0, n_materials * sizeof *s->material_contour_lookup);
+	for (int i = 0; i < n_contour; i++) {
+		s->material_contour_lookup[o->polygon_materials[o->halfedge_polygon[contour[i]]]].length++;
+	}
+	int offset = 0;
+	for (int i = 0; i < n_materials; i++) {
+		union ipair* lu = &s->material_contour_lookup[i];
+		lu->offset = offset;
+		offset += lu->length;
+		lu->length = 0;
+	}
+	for (int i = 0; i < n_contour; i++) {
+		const int h = contour[i];
+		union ipair* lu = &s->material_contour_lookup[o->polygon_materials[o->halfedge_polygon[h]]];
+		s->contour_halfedges[lu->offset + lu->length++] = h;
+		s->halfedge_flags[h] = 0;
+	}
+
+	outline__set_transform(o, s, tx);
+	outline__transform_halfedge_vertices(o, s, s->contour_halfedges, n_contour);
+
+	for (int material = 0; material < n_materials; material++) {
+		const int *begin, *end;
+		ipair_lookup(&begin, &end, s->material_contour_lookup, material, s->contour_halfedges);
+
+		for (const int* it = begin; it < end; it++) {
+			if (s->halfedge_flags[*it] & VISITED) continue;
+
+			/* walk along the half-edges of the drawn side */
+			struct outline_contour_island* island = outline_contours__push_island(c);
+			island->material = material;
+			island->offset = c->n_points;
+			float area = 0.0f;
+			const int first_halfedge_index = *it;
+			int halfedge_index = first_halfedge_index;
+			union v3 prev_vertex = outline__get_halfedge_vertex(o, s, halfedge_index, 0);
+			outline_contours__push_point(c, prev_vertex, outline__halfedge_vertex_index(o, halfedge_index, 0));
+			do {
+				int* halfedge_flags = &s->halfedge_flags[halfedge_index];
+				assert((*halfedge_flags & VISITED) == 0);
+				*halfedge_flags |= VISITED;
+
+				union v3 vertex = outline__get_halfedge_vertex(o, s, halfedge_index, 1);
+				outline_contours__push_point(c, vertex, outline__halfedge_vertex_index(o, halfedge_index, 1));
+
+				area += (vertex.x - prev_vertex.x) * (vertex.y + prev_vertex.y);
+				prev_vertex = vertex;
+
+				halfedge_index = outline__follow(o, s, halfedge_index, material);
+			} while (halfedge_index != first_halfedge_index);
+
+			island->length = c->n_points - island->offset;
+			island->winding = area > 0 ? NVG_CW : NVG_CCW;
+		}
+	}
+}
+
+/* tolerances for reusing the previous outline_extract() result of c: the
+ * points are kept as they are if none of them can have moved more than
+ * pixels, and the outline is kept but re-projected if the view direction
+ * turned by at most radians (then the outline may be a little off where it
+ * would have changed). Both are 0 to begin with, which only skips work
+ * that would give the same result, and the demo keeps it that way.
+ * Tolerances only pay off while most frames stay within them: when the
+ * view turns further than radians every frame, each frame is a full
+ * find plus the tolerance checks and cache_radius, a little slower than
+ * exact caching (see bench_path at 0.01 rad/frame) */
+static void outline_contours_set_tolerance(struct outline_contours* c, float pixels, float radians)
+{
+	c->tolerance_pixels = pixels;
+	c->tolerance_radians = radians;
+	c->cache_valid = 0;
+}
+
+static void outline_contours__reproject(const struct outline* o, struct outline_contours* c, union m33* tx)
+{
+	union v3 vertices[OUTLINE_TX_BATCH];
+	for (int i = 0; i < c->n_points; i += OUTLINE_TX_BATCH) {
+		const int n = (c->n_points - i < OUTLINE_TX_BATCH) ? c->n_points - i : OUTLINE_TX_BATCH;
+		for (int k = 0; k < n; k++) vertices[k] = o->vertices[c->point_vertices[i+k]];
+		m33_apply_batch(tx, vertices, vertices, n);
+		for (int k = 0; k < n; k++) {
+			c->points[2*(i+k)] = vertices[k].x;
+			c->points[2*(i+k)+1] = vertices[k].y;
+		}
+	}
+	c->cache_tx = *tx;
+}
+
+/* finds the outlines of all materials with one classification pass: every
+ * polygon facing the "camera" (according to tx) is tagged, and the outline
+ * half-edges of all materials are found in one go. The outlines are walked
+ * and stored as transformed points in c. Uses the coarsest level of detail
+ * of o that looks the same at the scale of tx (see outline_select_lod()).
+ * The previous result in c is reused when the transform is close enough to
+ * the one it was made with (see outline_contours_set_tolerance()), or when
+ * an incremental scratch finds the same outline half-edges as last time.
+ * Only touches s and c, so it can run on any thread as long as s and c are
+ * not shared */
+static void outline_extract(const struct outline* o, struct outline_scratch* s, union m33* tx, struct outline_contours* c)
+{
+	o = outline_select_lod(o, tx);
+
+	union v3 view = m33_get_view_v3(tx);
+
+	const int cached = c->cache_valid && c->cache_lod == o;
+	if (cached) {
+		/* |(tx - cache_tx) v| <= |tx - cache_tx| |v| for every point */
+		float d2 = 0.0f;
+		for (int i = 0; i < 9; i++) d2 += (tx->s[i] - c->cache_tx.s[i]) * (tx->s[i] - c->cache_tx.s[i]);
+		if (d2 == 0.0f) return;
+		if (c->tolerance_pixels > 0.0f && c->n_points > 0 && sqrtf(d2) * c->cache_radius <= c->tolerance_pixels) return;
+
+		/* against the view the outline was found for, not the last
+		 * re-projection's, so small turns can't add up unchecked */
+		const union v3 found_view = c->cache_found_view;
+		if (c->tolerance_radians > 0.0f && v3_dot(view, found_view) >= v3_length(view) * v3_length(found_view) * cosf(c->tolerance_radians)) {
+			outline_contours__reproject(o, c, tx);
+			return;
+		}
+	}
+
+	const int* contour;
+	const int n_contour = outline__find_contour(o, s, view, &contour);
+	if (cached && c->cache_scratch == s && c->cache_contour_version == s->contour_version) {
+		outline_contours__reproject(o, c, tx);
+		c->cache_found_view = view;
+		return;
+	}
+
+	outline__walk_contour(o, s, tx, contour, n_contour, c);
+
+	c->cache_valid = 1;
+	c->cache_lod = o;
+	c->cache_scratch = s;
+	c->cache_contour_version = s->contour_version;
+	c->cache_tx = *tx;
+	c->cache_found_view = view;
+	c->cache_radius = 0.0f;
+	for (int i = 0; i < c->n_points && c->tolerance_pixels > 0.0f; i++) {
+		const float r = v3_length(o->vertices[c->point_vertices[i]]);
+		if (r > c->cache_radius) c->cache_radius = r;
+	}
+}
+
+/* replays extracted outlines into vg; one path per material, after which
+ * material_fn is called to fill/stroke it. Returns the number of materials
+ * drawn */
+static int outline_emit(const struct outline_contours* c, NVGcontext* vg, void (*material_fn)(NVGcontext* vg, int material, void* usr), void* usr)
+{
+	int n_drawn = 0;
+	for (int i = 0; i < c->n_islands; ) {
+		const int material = c->islands[i].material;
+		nvgBeginPath(vg);
+		for (; i < c->n_islands && c->islands[i].material == material; i++) {
+			const struct outline_contour_island* island = &c->islands[i];
+			const float* p = &c->points[2*island->offset];
+			nvgMoveTo(vg, p[0], p[1]);
+			for (int k = 1; k < island->length; k++) nvgLineTo(vg, p[2*k], p[2*k+1]);
+			nvgClosePath(vg);
+			nvgPathWinding(vg, island->winding);
+		}
+		material_fn(vg, material, usr);
+		n_drawn++;
+	}
+	return n_drawn;
+}
+
+static void outline_init_hat(struct outline* o, int n_segments, int n_strips)
+{
+	const float radius = 100.0f;
+
+	const int n_vertices = n_segments * n_strips + 1;
+	const int n_polygons = n_segments * n_strips;
+	const int n_polygon_vertex_indices = (4*(n_segments-1)*n_strips) + 3*n_strips;
+	outline_alloc(o, n_vertices, n_polygons, n_polygon_vertex_indices);
+
+	int vi = 0;
+	int pi = 0;
+	int pvi = 0;
+	int segment_offset = 0;
+	for (int i = 0; i < n_segments; i++) {
+		union v3 v;
+		float it = ((float)-i / (float)n_segments) * NVG_PI * 0.5f;
+		float r = cosf(it);
+		v.y = -sinf(it) * radius;
+
+		/* material bands are laid out for 12 segments; scale for
+		 * other resolutions */
+		const int band = (i * 12) / n_segments;
+		const int polygon_material = (band == 1 || band == 4 || band > 6) ? 1 : 0;
+		const int is_top = (i == n_segments-1);
+		const int n_polygon_sides = is_top ? 3 : 4;
+
+		int jprev = n_strips-1;
+		for (int j = 0; j < n_strips; j++) {
+			float jphi = ((float)j / (float)n_strips) * NVG_PI * 2.0f;
+
+			// XXX choose different curve maybe?
+			v.x = sinf(jphi) * r * radius;
+			v.z = cosf(jphi) * r * radius;
+
+			assert(vi < n_vertices);
+			o->vertices[vi] = v;
+			vi++;
+
+			assert(pi < n_polygons);
+			o->polygon_materials[pi] = polygon_material;
+			o->polygon_lookup[pi].offset = pvi;
+			o->polygon_lookup[pi].length = n_polygon_sides;
+			pi++;
+
+			o->polygon_vertex_indices[pvi++] = jprev + segment_offset;
+			o->polygon_vertex_indices[pvi++] = j + segment_offset;
+			if (is_top) {
+				o->polygon_vertex_indices[pvi++] = n_vertices-1;
+			} else {
+				o->polygon_vertex_indices[pvi++] = j + segment_offset + n_strips;
+				o->polygon_vertex_indices[pvi++] = jprev + segment_offset + n_strips;
+			}
+			assert(pvi == o->polygon_lookup[pi-1].offset + n_polygon_sides);
+			jprev = j;
+		}
+		segment_offset += n_strips;
+	}
+
+	o->vertices[vi++] = (union v3){.y = radius};
+
+	outline_prep(o);
+}
+
+static struct outline* outline_create_hat(int n_segments, int n_strips)
+{
+	struct outline* o = xcalloc(1, sizeof *o);
+	outline_init_hat(o, n_segments, n_strips);
+	SDL_AtomicSet(&o->refcount, 1);
+	return o;
+}
+
+/* mesh cache file: a header followed by the arena of a prepped outline, as
+ * laid out by outline__layout(), then the same for each coarser level of
+ * its chain (see outline_prep_lods()) up to the end of the file. Loading
+ * maps the file and points the arrays of every level straight into the
+ * mapping, so there is no prep and no copying. The format is the in-memory
+ * layout, so bump OUTLINE_CACHE_VERSION whenever struct outline or
+ * outline__layout() changes. The header is 64 bytes and arena sizes are
+ * multiples of ARENA_ALIGNMENT, so every arena is as aligned in the
+ * mapping as in memory */
+#define OUTLINE_CACHE_MAGIC "OUTLINE"
+#define OUTLINE_CACHE_VERSION (2)
+
+struct outline_cache_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order; // 0x01020304 as written
+	uint32_t sizeof_v3;
+	uint32_t sizeof_ipair;
+	int32_t n_vertices;
+	int32_t n_polygons;
+	int32_t n_halfedges;
+	int32_t n_materials;
+	int32_t n_edges;
+	int32_t normal_cone_leaf_level;
+	int32_t n_normal_cones;
+	float lod_error;
+	uint64_t arena_size;
+};
+
+static void outline_cache__header(struct outline_cache_header* h, const struct outline* o)
+{
+	assert(sizeof *h % ARENA_ALIGNMENT == 0);
+	memset(h, 0, sizeof *h);
+	memcpy(h->magic, OUTLINE_CACHE_MAGIC, sizeof OUTLINE_CACHE_MAGIC);
+	h->version = OUTLINE_CACHE_VERSION;
+	h->byte_order = 0x01020304;
+	h->sizeof_v3 = sizeof(union v3);
+	h->sizeof_ipair = sizeof(union ipair);
+	h->n_vertices = o->n_vertices;
+	h->n_polygons = o->n_polygons;
+	h->n_halfedges = o->n_halfedges;
+	h->n_materials = o->n_materials;
+	h->n_edges = o->n_edges;
+	h->normal_cone_leaf_level = o->normal_cone_leaf_level;
+	h->n_normal_cones = o->n_normal_cones;
+	h->lod_error = o->lod_error;
+	h->arena_size = o->arena.used;
+}
+
+/* writes a prepped outline and its levels of detail to a cache file;
+ * returns 0 on success */
+static int outline_save(const struct outline* o, const char* path)
+{
+	FILE* f = fopen(path, "wb");
+	if (f == NULL) {
+		fprintf(stderr, "%s: cannot open for writing\n", path);
+		return -1;
+	}
+	int ok = 1;
+	for (const struct outline* level = o; level != NULL && ok; level = level->lod) {
+		struct outline_cache_header h;
+		outline_cache__header(&h, level);
+		ok = fwrite(&h, sizeof h, 1, f) == 1;
+		if (ok && h.arena_size > 0) ok = fwrite(level->arena.base, h.arena_size, 1, f) == 1;
+	}
+	if (fclose(f) != 0) ok = 0;
+	if (!ok) {
+		fprintf(stderr, "%s: write failed\n", path);
+		remove(path);
+		return -1;
+	}
+	return 0;
+}
+
+/* points level at the arena whose header is at offset in a mapped cache
+ * file of size bytes; returns 0 if the header is valid for this build */
+static int outline_load__level(struct outline* level, const char* mapping, size_t size, size_t offset)
+{
+	if (size - offset < sizeof(struct outline_cache_header)) return -1;
+	const struct outline_cache_header* h = (const void*)(mapping + offset);
+	memset(level, 0, sizeof *level);
+	level->n_vertices = h->n_vertices;
+	level->n_polygons = h->n_polygons;
+	level->n_halfedges = h->n_halfedges;
+	level->n_materials = h->n_materials;
+	level->n_edges = h->n_edges;
+	level->normal_cone_leaf_level = h->normal_cone_leaf_level;
+	level->n_normal_cones = h->n_normal_cones;
+	level->lod_error = h->lod_error;
+	struct outline_cache_header expected;
+	outline_cache__header(&expected, level);
+	if (!(h->normal_cone_leaf_level >= 0 && h->normal_cone_leaf_level <= NORMAL_CONE_MAX_LEAF_LEVEL && h->lod_error >= 0.0f)) return -1;
+	/* the counts must give the arena size that was written */
+	struct arena measure = {0};
+	outline__layout(level, &measure);
+	expected.arena_size = measure.used;
+	if (memcmp(h, &expected, sizeof expected) != 0 || h->arena_size > size - offset - sizeof *h) return -1;
+
+	level->arena.base = (char*)mapping + offset + sizeof *h;
+	level->arena.size = h->arena_size;
+	outline__layout(level, &level->arena);
+	return 0;
+}
+
+/* maps a cache file written by outline_save(); returns 0 on success, or -1
+ * if the file is missing, truncated or from another version/platform, in
+ * which case o is untouched. The levels of detail come back as they were
+ * saved, sharing the one mapping */
+static int outline_load(struct outline* o, const char* path)
+{
+	const int fd = open(path, O_RDONLY);
+	if (fd == -1) return -1;
+	struct stat st;
+	void* mapping = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(struct outline_cache_header)) {
+		mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if (mapping == MAP_FAILED) return -1;
+
+	const size_t size = st.st_size;
+	struct outline tmp;
+	int ok = outline_load__level(&tmp, mapping, size, 0) == 0;
+	size_t offset = sizeof(struct outline_cache_header) + tmp.arena.size;
+	struct outline* level = &tmp;
+	while (ok && offset < size) {
+		struct outline* lod = xcalloc(1, sizeof *lod);
+		ok = outline_load__level(lod, mapping, size, offset) == 0;
+		if (ok) {
+			lod->arena.mapping = mapping;
+			offset += sizeof(struct outline_cache_header) + lod->arena.size;
+		}
+		level->lod = lod;
+		level = lod;
+	}
+	if (!ok) {
+		fprintf(stderr, "%s: not a version %d outline cache for this build\n", path, OUTLINE_CACHE_VERSION);
+		/* the levels don't own the mapping yet, so this only frees them */
+		tmp.arena.base = NULL;
+		outline_free(&tmp);
+		munmap(mapping, size);
+		return -1;
+	}
+
+	tmp.arena.mapping = mapping;
+	tmp.arena.mapping_size = size;
+	*o = tmp;
+	return 0;
+}
+
+static struct outline* outline_create_load(const char* path)
+{
+	struct outline* o = xcalloc(1, sizeof *o);
+	if (outline_load(o, path) != 0) {
+		free(o);
+		return NULL;
+	}
+	SDL_AtomicSet(&o->refcount, 1);
+	return o;
+}
+
+/* mesh import. Files are streamed through one fixed buffer and parsed
+ * straight into growable "specified" arrays (no allocations per face),
+ * which end up in the outline's arena. OBJ (v/f/usemtl) and PLY (ascii
+ * and binary, vertex x/y/z, face vertex_indices and material_index) */
+#define IMPORT_CHUNK_SIZE (1 << 20)
+
+struct import {
+	const char* path;
+	FILE* f;
+	char* buf; // IMPORT_CHUNK_SIZE+1, NUL after the last byte read
+	size_t len;
+	size_t pos;
+	int eof;
+	int line_number;
+	int error;
+
+	int n_vertices;
+	int vertices_cap;
+	union v3* vertices;
+	int n_polygons;
+	int polygons_cap;
+	int* polygon_materials;
+	union ipair* polygon_lookup;
+	int n_indices;
+	int indices_cap;
+	int* polygon_vertex_indices;
+	int polygon_offset; // first index of the polygon being read
+};
+
+static void import__error(struct import* im, const char* fmt, ...)
+{
+	if (im->error) return;
+	im->error = 1;
+	va_list ap;
+	va_start(ap, fmt);
+	fprintf(stderr, "%s:%d: ", im->path, im->line_number);
+	vfprintf(stderr, fmt, ap);
+	fprintf(stderr, "\n");
+	va_end(ap);
+}
+
+/* moves unread bytes to the front of the buffer and reads more after them */
+static void import__refill(struct import* im)
+{
+	memmove(im->buf, im->buf + im->pos, im->len - im->pos);
+	im->len -= im->pos;
+	im->pos = 0;
+	if (!im->eof) {
+		const size_t n = fread(im->buf + im->len, 1, IMPORT_CHUNK_SIZE - im->len, im->f);
+		if (n == 0) im->eof = 1;
+		im->len += n;
+	}
+	im->buf[im->len] = '\0';
+}
+
+/* returns the next line, NUL-terminated in place without the newline, or
+ * NULL at the end of the file */
+static char* import__line(struct import* im)
+{
+	char* nl;
+	while ((nl = memchr(im->buf + im->pos, '\n', im->len - im->pos)) == NULL) {
+		if (im->eof) {
+			if (im->pos == im->len) return NULL;
+			nl = im->buf + im->len; /* last line without newline */
+			break;
+		}
+		if (im->pos == 0 && im->len == IMPORT_CHUNK_SIZE) {
+			import__error(im, "line too long");
+			return NULL;
+		}
+		import__refill(im);
+	}
+	char* line = im->buf + im->pos;
+	im->pos = (nl - im->buf) + (nl < im->buf + im->len ? 1 : 0);
+	*nl = '\0';
+	im->line_number++;
+	return line;
+}
+
+/* returns the next n bytes in the buffer (valid until the next read), or
+ * NULL if the file ends before that */
+static inline const unsigned char* import__take(struct import* im, size_t n)
+{
+	if (im->len - im->pos < n) {
+		while (im->len - im->pos < n && !im->eof && n <= IMPORT_CHUNK_SIZE) import__refill(im);
+		if (im->len - im->pos < n) {
+			import__error(im, "unexpected end of file");
+			return NULL;
+		}
+	}
+	const unsigned char* p = (const unsigned char*)im->buf + im->pos;
+	im->pos += n;
+	return p;
+}
+
+static inline const char* import__skip_space(const char* p)
+{
+	while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+	return p;
+}
+
+static inline const char* import__skip_token(const char* p)
+{
+	while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\r') p++;
+	return p;
+}
+
+/* parses an integer at p; returns the end of it, or NULL if there is none */
+static const char* import__parse_int(const char* p, int* out)
+{
+	int negative = 0;
+	if (*p == '-' || *p == '+') negative = (*p++ == '-');
+	if (!(*p >= '0' && *p <= '9')) return NULL;
+	long long v = 0;
+	for (; *p >= '0' && *p <= '9'; p++) {
+		v = v*10 + (*p - '0');
+		if (v > INT_MAX) return NULL;
+	}
+	*out = negative ? -(int)v : (int)v;
+	return p;
+}
+
+/* parses a number at p; returns the end of it, or NULL if there is none.
+ * Plain decimals with up to 19 digits and small exponents take the fast
+ * path; strtod() handles the rest (inf, nan, hex, huge exponents) */
+static const char* import__parse_double(const char* p, double* out)
+{
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	const char* begin = p;
+	int negative = 0;
+	if (*p == '-' || *p == '+') negative = (*p++ == '-');
+	uint64_t mantissa = 0;
+	int n_digits = 0;
+	int exponent = 0;
+	for (; *p >= '0' && *p <= '9'; p++, n_digits++) mantissa = mantissa*10 + (*p - '0');
+	if (*p == '.') {
+		for (p++; *p >= '0' && *p <= '9'; p++, n_digits++, exponent--) mantissa = mantissa*10 + (*p - '0');
+	}
+	int fast = (n_digits > 0 && n_digits <= 19);
+	if (fast && (*p == 'e' || *p == 'E')) {
+		p++;
+		int exponent_negative = 0;
+		if (*p == '-' || *p == '+') exponent_negative = (*p++ == '-');
+		int e = 0;
+		int n_exponent_digits = 0;
+		for (; *p >= '0' && *p <= '9'; p++, n_exponent_digits++) if (e < 10000) e = e*10 + (*p - '0');
+		if (n_exponent_digits == 0) fast = 0;
+		exponent += exponent_negative ? -e : e;
+	}
+	if (fast && exponent >= -22 && exponent <= 22) {
+		const double v = (exponent < 0) ? (double)mantissa / pow10[-exponent] : (double)mantissa * pow10[exponent];
+		*out = negative ? -v : v;
+		return p;
+	}
+	char* end;
+	*out = strtod(begin, &end);
+	return (end == begin) ? NULL : end;
+}
+
+/* bytes of the file not read yet, or -1 if the file can't tell */
+static long long import__bytes_left(struct import* im)
+{
+	const long here = ftell(im->f);
+	if (here < 0 || fseek(im->f, 0, SEEK_END) != 0) return -1;
+	const long end = ftell(im->f);
+	if (fseek(im->f, here, SEEK_SET) != 0 || end < here) {
+		import__error(im, "cannot seek");
+		return -1;
+	}
+	return (long long)(end - here) + (long long)(im->len - im->pos);
+}
+
+/* grows the staged arrays to hold at least this many, when the file tells
+ * the counts up front */
+static void import__reserve(struct import* im, int n_vertices, int n_polygons, int n_indices)
+{
+	if (n_vertices > im->vertices_cap) {
+		im->vertices_cap = n_vertices;
+		im->vertices = xrealloc(im->vertices, im->vertices_cap * sizeof *im->vertices);
+	}
+	if (n_polygons > im->polygons_cap) {
+		im->polygons_cap = n_polygons;
+		im->polygon_materials = xrealloc(im->polygon_materials, im->polygons_cap * sizeof *im->polygon_materials);
+		im->polygon_lookup = xrealloc(im->polygon_lookup, im->polygons_cap * sizeof *im->polygon_lookup);
+	}
+	if (n_indices > im->indices_cap) {
+		im->indices_cap = n_indices;
+		im->polygon_vertex_indices = xrealloc(im->polygon_vertex_indices, im->indices_cap * sizeof *im->polygon_vertex_indices);
+	}
+}
+
+static void import__add_vertex(struct import* im, union v3 v)
+{
+	if (im->n_vertices == im->vertices_cap) {
+		im->vertices_cap = im->vertices_cap ? 2*im->vertices_cap : 4096;
+		im->vertices = xrealloc(im->vertices, im->vertices_cap * sizeof *im->vertices);
+	}
+	im->vertices[im->n_vertices++] = v;
+}
+
+static inline void import__begin_polygon(struct import* im)
+{
+	im->polygon_offset = im->n_indices;
+}
+
+/* drops consecutive repeats of a vertex; a polygon cannot use them */
+static inline void import__add_index(struct import* im, int vertex_index)
+{
+	if (im->n_indices > im->polygon_offset && im->polygon_vertex_indices[im->n_indices-1] == vertex_index) return;
+	if (im->n_indices == im->indices_cap) {
+		im->indices_cap = im->indices_cap ? 2*im->indices_cap : 16384;
+		im->polygon_vertex_indices = xrealloc(im->polygon_vertex_indices, im->indices_cap * sizeof *im->polygon_vertex_indices);
+	}
+	im->polygon_vertex_indices[im->n_indices++] = vertex_index;
+}
+
+/* ends the polygon begun by import__begin_polygon(); degenerate ones (fewer
+ * than 3 distinct consecutive vertices) are dropped */
+static void import__end_polygon(struct import* im, int material)
+{
+	const int offset = im->polygon_offset;
+	if (im->n_indices - offset > 1 && im->polygon_vertex_indices[im->n_indices-1] == im->polygon_vertex_indices[offset]) {
+		im->n_indices--;
+	}
+	if (im->n_indices - offset < 3) {
+		im->n_indices = offset;
+		return;
+	}
+	if (material < 0) {
+		import__error(im, "negative material");
+		return;
+	}
+	if (im->n_polygons == im->polygons_cap) {
+		im->polygons_cap = im->polygons_cap ? 2*im->polygons_cap : 4096;
+		im->polygon_materials = xrealloc(im->polygon_materials, im->polygons_cap * sizeof *im->polygon_materials);
+		im->polygon_lookup = xrealloc(im->polygon_lookup, im->polygons_cap * sizeof *im->polygon_lookup);
+	}
+	im->polygon_materials[im->n_polygons] = material;
+	im->polygon_lookup[im->n_polygons].offset = offset;
+	im->polygon_lookup[im->n_polygons].length = im->n_indices - offset;
+	im->n_polygons++;
+}
+
+/* material index of name in the order of first use; names are copied */
+static int import__material(char*** names, int* n_names, const char* name)
+{
+	for (int i = 0; i < *n_names; i++) if (strcmp((*names)[i], name) == 0) return i;
+	*names = xrealloc(*names, (*n_names + 1) * sizeof **names);
+	const size_t size = strlen(name) + 1;
+	char* copy = xcalloc(size, 1);
+	memcpy(copy, name, size);
+	(*names)[*n_names] = copy;
+	return (*n_names)++;
+}
+
+/* materials are numbered by first "usemtl"; faces before any usemtl count
+ * as a material named "" */
+static void import__obj(struct import* im)
+{
+	char** material_names = NULL;
+	int n_material_names = 0;
+	int material = -1;
+	char* line;
+	while (!im->error && (line = import__line(im)) != NULL) {
+		const char* p = import__skip_space(line);
+		if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+			union v3 v;
+			p += 2;
+			for (int k = 0; k < 3 && p != NULL; k++) {
+				double x;
+				p = import__parse_double(import__skip_space(p), &x);
+				v.s[k] = x;
+			}
+			if (p == NULL) {
+				import__error(im, "bad vertex");
+				break;
+			}
+			import__add_vertex(im, v);
+		} else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+			import__begin_polygon(im);
+			for (p += 2; *(p = import__skip_space(p)) != '\0'; p = import__skip_token(p)) {
+				/* v, v/vt, v//vn or v/vt/vn; negative indices count
+				 * back from the last vertex */
+				int index;
+				p = import__parse_int(p, &index);
+				if (p == NULL || index == 0) {
+					import__error(im, "bad face");
+					break;
+				}
+				import__add_index(im, index > 0 ? index-1 : im->n_vertices + index);
+			}
+			if (material < 0) material = import__material(&material_names, &n_material_names, "");
+			import__end_polygon(im, material);
+		} else if (strncmp(p, "usemtl", 6) == 0 && (p[6] == ' ' || p[6] == '\t')) {
+			char* name = (char*)import__skip_space(p+6);
+			*(char*)import__skip_token(name) = '\0';
+			material = import__material(&material_names, &n_material_names, name);
+		}
+		/* the rest (comments, normals, texture coordinates, groups,
+		 * smoothing, mtllib) doesn't matter for outlines */
+	}
+	for (int i = 0; i < n_material_names; i++) free(material_names[i]);
+	free(material_names);
+}
+
+enum {
+	PLY_INT8,
+	PLY_UINT8,
+	PLY_INT16,
+	PLY_UINT16,
+	PLY_INT32,
+	PLY_UINT32,
+	PLY_FLOAT32,
+	PLY_FLOAT64,
+	PLY_N_TYPES
+};
+
+static const struct {
+	const char* names[2];
+	int size;
+} ply_types[PLY_N_TYPES] = {
+	{{"char", "int8"}, 1},
+	{{"uchar", "uint8"}, 1},
+	{{"short", "int16"}, 2},
+	{{"ushort", "uint16"}, 2},
+	{{"int", "int32"}, 4},
+	{{"uint", "uint32"}, 4},
+	{{"float", "float32"}, 4},
+	{{"double", "float64"}, 8},
+};
+
+#define PLY_ASCII (0)
+#define PLY_BINARY_LITTLE_ENDIAN (1)
+#define PLY_BINARY_BIG_ENDIAN (2)
+#define PLY_MAX_ELEMENTS (8)
+#define PLY_MAX_PROPERTIES (16)
+
+struct ply_property {
+	char name[32];
+	int type;
+	int count_type; // -1 unless it is a list
+};
+
+struct ply_element {
+	char name[32];
+	int count;
+	int n_properties;
+	struct ply_property properties[PLY_MAX_PROPERTIES];
+};
+
+static int ply_type(const char* name)
+{
+	for (int i = 0; i < PLY_N_TYPES; i++) {
+		if (strcmp(name, ply_types[i].names[0]) == 0 || strcmp(name, ply_types[i].names[1]) == 0) return i;
+	}
+	return -1;
+}
+
+/* reads one value; ascii values come from *p, the current line, binary
+ * ones from the buffer, byte swapped if swap is set */
+static inline double import__ply_value(struct import* im, int format, int swap, int type, const char** p)
+{
+	if (format == PLY_ASCII) {
+		double v = 0.0;
+		const char* end = import__parse_double(import__skip_space(*p), &v);
+		if (end == NULL) {
+			import__error(im, "bad value");
+			return 0.0;
+		}
+		*p = end;
+		return v;
+	}
+
+	const int size = ply_types[type].size;
+	const unsigned char* src = import__take(im, size);
+	if (src == NULL) return 0.0;
+	unsigned char b[8];
+	if (swap) {
+		for (int i = 0; i < size; i++) b[i] = src[size-1-i];
+		src = b;
+	}
+	switch (type) {
+	case PLY_INT8: { int8_t x; memcpy(&x, src, sizeof x); return x; }
+	case PLY_UINT8: { uint8_t x; memcpy(&x, src, sizeof x); return x; }
+	case PLY_INT16: { int16_t x; memcpy(&x, src, sizeof x); return x; }
+	case PLY_UINT16: { uint16_t x; memcpy(&x, src, sizeof x); return x; }
+	case PLY_INT32: { int32_t x; memcpy(&x, src, sizeof x); return x; }
+	case PLY_UINT32: { uint32_t x; memcpy(&x, src, sizeof x); return x; }
+	case PLY_FLOAT32: { float x; memcpy(&x, src, sizeof x); return x; }
+	default: { double x; memcpy(&x, src, sizeof x); return x; }
+	}
+}
+
+/* reads one value that must be a whole int: counts, indices, materials.
+ * Anything else (nan, 1e30, huge float32s) is an error rather than an
+ * undefined conversion */
+static inline int import__ply_int(struct import* im, int format, int swap, int type, const char** p)
+{
+	const double x = import__ply_value(im, format, swap, type, p);
+	if (!(x >= INT_MIN && x <= INT_MAX)) {
+		import__error(im, "value out of range");
+		return 0;
+	}
+	return (int)x;
+}
+
+/* fewest bytes an item of e can take in the file: 1 digit and a separator
+ * per ascii value, the value or list count size in binary */
+static int ply_min_item_size(const struct ply_element* e, int format)
+{
+	int size = 0;
+	for (int i = 0; i < e->n_properties; i++) {
+		const struct ply_property* pr = &e->properties[i];
+		size += (format == PLY_ASCII) ? 2 : ply_types[pr->count_type >= 0 ? pr->count_type : pr->type].size;
+	}
+	return size;
+}
+
+static void import__ply(struct import* im)
+{
+	int format = -1;
+	int n_elements = 0;
+	struct ply_element elements[PLY_MAX_ELEMENTS];
+	char* line;
+	import__line(im); /* "ply" */
+	for (;;) {
+		if ((line = import__line(im)) == NULL) {
+			import__error(im, "unexpected end of header");
+			return;
+		}
+		char a[32], b[32], c[32];
+		int count;
+		if (strncmp(line, "end_header", 10) == 0) {
+			break;
+		} else if (sscanf(line, "format %31s", a) == 1) {
+			if (strcmp(a, "ascii") == 0) format = PLY_ASCII;
+			else if (strcmp(a, "binary_little_endian") == 0) format = PLY_BINARY_LITTLE_ENDIAN;
+			else if (strcmp(a, "binary_big_endian") == 0) format = PLY_BINARY_BIG_ENDIAN;
+		} else if (sscanf(line, "element %31s %d", a, &count) == 2) {
+			if (n_elements == PLY_MAX_ELEMENTS || count < 0) {
+				import__error(im, "unsupported element");
+				return;
+			}
+			struct ply_element* e = &elements[n_elements++];
+			memset(e, 0, sizeof *e);
+			memcpy(e->name, a, sizeof e->name);
+			e->count = count;
+		} else if (strncmp(line, "property", 8) == 0) {
+			if (n_elements == 0 || elements[n_elements-1].n_properties == PLY_MAX_PROPERTIES) {
+				import__error(im, "unsupported property");
+				return;
+			}
+			struct ply_element* e = &elements[n_elements-1];
+			struct ply_property* pr = &e->properties[e->n_properties++];
+			if (sscanf(line, "property list %31s %31s %31s", a, b, c) == 3) {
+				pr->count_type = ply_type(a);
+				pr->type = ply_type(b);
+				memcpy(pr->name, c, sizeof pr->name);
+				if (pr->count_type < 0) pr->type = -1;
+			} else if (sscanf(line, "property %31s %31s", a, b) == 2) {
+				pr->count_type = -1;
+				pr->type = ply_type(a);
+				memcpy(pr->name, b, sizeof pr->name);
+			} else {
+				pr->type = -1;
+			}
+			if (pr->type < 0) {
+				import__error(im, "bad property");
+				return;
+			}
+		}
+		/* comment, obj_info */
+	}
+	if (format < 0) {
+		import__error(im, "unsupported format");
+		return;
+	}
+	const int one = 1;
+	const int host_little_endian = *(const char*)&one;
+	const int swap = (format != PLY_ASCII) && (host_little_endian != (format == PLY_BINARY_LITTLE_ENDIAN));
+
+	/* the header's counts must fit in what is left of the file, before
+	 * anything is reserved for them */
+	long long bytes_left = import__bytes_left(im);
+	if (format == PLY_ASCII && bytes_left >= 0) bytes_left++; /* no newline after the last line */
+	for (int ei = 0; ei < n_elements && bytes_left >= 0; ei++) {
+		bytes_left -= (long long)elements[ei].count * ply_min_item_size(&elements[ei], format);
+		if (bytes_left < 0) {
+			import__error(im, "%d %s elements don't fit in the file", elements[ei].count, elements[ei].name);
+			return;
+		}
+	}
+
+	for (int ei = 0; ei < n_elements && !im->error; ei++) {
+		const struct ply_element* e = &elements[ei];
+		const int is_vertex = strcmp(e->name, "vertex") == 0;
+		const int is_face = strcmp(e->name, "face") == 0;
+		/* property index of x/y/z for vertices, or of the index list
+		 * and the material for faces */
+		int roles[3] = {-1, -1, -1};
+		for (int i = 0; i < e->n_properties; i++) {
+			const struct ply_property* pr = &e->properties[i];
+			if (is_vertex && pr->count_type < 0 && pr->name[0] >= 'x' && pr->name[0] <= 'z' && pr->name[1] == '\0') {
+				roles[pr->name[0] - 'x'] = i;
+			} else if (is_face && pr->count_type >= 0 && (strcmp(pr->name, "vertex_indices") == 0 || strcmp(pr->name, "vertex_index") == 0)) {
+				roles[0] = i;
+			} else if (is_face && pr->count_type < 0 && strcmp(pr->name, "material_index") == 0) {
+				roles[1] = i;
+			}
+		}
+		if ((is_vertex && (roles[0] < 0 || roles[1] < 0 || roles[2] < 0)) || (is_face && roles[0] < 0)) {
+			import__error(im, "%s element lacks %s", e->name, is_vertex ? "x/y/z" : "vertex_indices");
+			return;
+		}
+		/* faces are mostly quads or triangles */
+		if (is_vertex) import__reserve(im, e->count, 0, 0);
+		if (is_face) import__reserve(im, 0, e->count, e->count <= INT_MAX/4 ? 4*e->count : e->count);
+
+		for (int item = 0; item < e->count && !im->error; item++) {
+			const char* p = "";
+			if (format == PLY_ASCII && (p = import__line(im)) == NULL) {
+				import__error(im, "unexpected end of file");
+				return;
+			}
+			union v3 v = {{0}};
+			int material = 0;
+			if (is_face) import__begin_polygon(im);
+			for (int i = 0; i < e->n_properties; i++) {
+				const struct ply_property* pr = &e->properties[i];
+				if (pr->count_type >= 0) {
+					const int n = import__ply_int(im, format, swap, pr->count_type, &p);
+					for (int k = 0; k < n && !im->error; k++) {
+						if (is_face && i == roles[0]) {
+							import__add_index(im, import__ply_int(im, format, swap, pr->type, &p));
+						} else {
+							import__ply_value(im, format, swap, pr->type, &p);
+						}
+					}
+				} else if (is_face && i == roles[1]) {
+					material = import__ply_int(im, format, swap, pr->type, &p);
+				} else {
+					const double x = import__ply_value(im, format, swap, pr->type, &p);
+					if (is_vertex) {
+						for (int k = 0; k < 3; k++) if (i == roles[k]) v.s[k] = x;
+					}
+				}
+			}
+			if (is_vertex) import__add_vertex(im, v);
+			if (is_face) import__end_polygon(im, material);
+		}
+	}
+}
+
+/* reads a mesh file into the "specified" section of o (see
+ * outline_alloc()); outline_prep() is up to the caller. Returns 0 on
+ * success; otherwise prints an error and leaves o untouched */
+static int outline_import_specified(struct outline* o, const char* path)
+{
+	struct import im;
+	memset(&im, 0, sizeof im);
+	im.path = path;
+	if ((im.f = fopen(path, "rb")) == NULL) {
+		fprintf(stderr, "%s: cannot open\n", path);
+		return -1;
+	}
+	im.buf = xcalloc(IMPORT_CHUNK_SIZE+1, 1);
+	import__refill(&im);
+	if (im.len >= 4 && memcmp(im.buf, "ply", 3) == 0 && (im.buf[3] == '\n' || im.buf[3] == '\r')) {
+		import__ply(&im);
+	} else {
+		import__obj(&im);
+	}
+	fclose(im.f);
+	free(im.buf);
+
+	for (int i = 0; i < im.n_indices && !im.error; i++) {
+		if (im.polygon_vertex_indices[i] < 0 || im.polygon_vertex_indices[i] >= im.n_vertices) {
+			import__error(&im, "vertex index %d out of range", im.polygon_vertex_indices[i]);
+		}
+	}
+	if (!im.error && im.n_polygons == 0) import__error(&im, "no polygons");
+
+	if (!im.error) {
+		outline_alloc(o, im.n_vertices, im.n_polygons, im.n_indices);
+		memcpy(o->vertices, im.vertices, im.n_vertices * sizeof *o->vertices);
+		memcpy(o->polygon_materials, im.polygon_materials, im.n_polygons * sizeof *o->polygon_materials);
+		memcpy(o->polygon_lookup, im.polygon_lookup, im.n_polygons * sizeof *o->polygon_lookup);
+		memcpy(o->polygon_vertex_indices, im.polygon_vertex_indices, im.n_indices * sizeof *o->polygon_vertex_indices);
+	}
+	free(im.vertices);
+	free(im.polygon_materials);
+	free(im.polygon_lookup);
+	free(im.polygon_vertex_indices);
+	return im.error ? -1 : 0;
+}
+
+static inline struct outline* outline_retain(struct outline* o)
+{
+	SDL_AtomicIncRef(&o->refcount);
+	return o;
+}
+
+static void outline_release(struct outline* o)
+{
+	if (!SDL_AtomicDecRef(&o->refcount)) return;
+	outline_free(o);
+	free(o);
+}
+
+/* xorshift32 streams, one per guy, so stepping guys shares no state (any
+ * guys may step on any threads) and a run replays exactly from its seeds */
+static uint32_t rng_seed(uint32_t seed)
+{
+	/* murmur3 finalizer, so neighbouring seeds give unrelated streams */
+	seed ^= seed >> 16;
+	seed *= 0x85ebca6bu;
+	seed ^= seed >> 13;
+	seed *= 0xc2b2ae35u;
+	seed ^= seed >> 16;
+	/* xorshift never leaves 0 */
+	return seed ? seed : 0x9e3779b9u;
+}
+
+static uint32_t rng_next(uint32_t* state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+/* uniform in [0;n) */
+static int rng_range(uint32_t* state, int n)
+{
+	return (int)(((uint64_t)rng_next(state) * (uint64_t)n) >> 32);
+}
+
+struct guy {
+	uint32_t rng;
+	float eye_r;
+	float eye_spacing;
+
+	float x;
+	float y;
+	float target_x;
+	float target_y;
+	float eye_left_blink;
+	float eye_right_blink;
+	int blink_timer;
+	float head_tilt;
+	float head_up;
+	float head_turn;
+	float head_bob_phi;
+	float lookat_x;
+	float lookat_y;
+};
+
+static void _guy_set_blink_timer(struct guy* guy)
+{
+	guy->blink_timer = 100 + rng_range(&guy->rng, 300);
+}
+
+static void guy_init(struct guy* guy, uint32_t seed)
+{
+	memset(guy, 0, sizeof *guy);
+	guy->rng = rng_seed(seed);
+	guy->eye_spacing = 0.5;
+	guy->eye_r = 1.8;
+	guy->head_up = 0;
+	guy->x = 100;
+	guy->y = 100;
+	guy->target_x = guy->x;
+	guy->target_y = guy->y;
+	_guy_set_blink_timer(guy);
+}
+
+static void guy_lookat(struct guy* guy, float x, float y)
+{
+	guy->lookat_x = x;
+	guy->lookat_y = y;
+}
+
+static void guy_set_target(struct guy* guy, float x, float y)
+{
+	guy->target_x = x;
+	guy->target_y = y;
+}
+
+static void guy_step(struct guy* guy)
+{
+	int is_walking = 0;
+	{
+		float dx = guy->target_x - guy->x;
+		float dy = guy->target_y - guy->y;
+		float dsqr = dx*dx + dy*dy;
+		if (dsqr > 0.01f) {
+			float d = sqrtf(dsqr);
+			float udx = dx / d;
+			float udy = dy / d;
+			float speed = 2.0f;
+			if (d < speed) speed = d;
+			guy->x += udx * speed;
+			guy->y += udy * speed;
+			guy->head_tilt = sinf(guy->head_bob_phi) * 0.15;
+			guy->head_turn = guy->head_tilt * 1.0 + udx * 0.5;
+			guy->head_bob_phi += 0.3f;
+			is_walking = 1;
+		} else {
+			guy->head_tilt = 0.0f;
+			guy->head_turn = 0.0f;
+			guy->head_bob_phi = 0.0f;
+		}
+	}
+
+	{
+		float dx = guy->lookat_x - guy->x;
+		float dy = guy->lookat_y - guy->y;
+		float dsqr = dx*dx + dy*dy;
+		const float dmax = 100.0f;
+		if (dsqr > 0 && dsqr < dmax*dmax) {
+			float d = sqrtf(dsqr);
+			float udx = dx / d;
+			float udy = dy / d;
+			float s = 1.0f;
+			const float ease_r = 20.0f;
+			if (d < ease_r) s = d / ease_r;
+			guy->head_turn = udx * 0.6 * s;
+			guy->head_up = udy * -5 * s;
+		} else {
+			if (!is_walking) guy->head_turn = 0.0f;
+			guy->head_up = 0.0f;
+		}
+	}
+
+	{
+		guy->blink_timer--;
+		if (guy->blink_timer < 0) {
+			const int blink_duration = 10;
+			float blink_t = (float)-guy->blink_timer / (float)blink_duration;
+			float blink = blink_t < 0.5f ? (blink_t*2.0f) : 1.0f - (blink_t - 0.5f)*2.0f;
+			guy->eye_left_blink = blink;
+			guy->eye_right_blink = blink;
+			if (guy->blink_timer < -blink_duration) {
+				_guy_set_blink_timer(guy);
+			}
+		} else {
+			guy->eye_left_blink = 0.0f;
+			guy->eye_right_blink = 0.0f;
+		}
+	}
+}
+
+#define GUY_HEAD_R (10.0f)
+
+/* the parts of a guy as subpaths, relative to the guy's position, for
+ * crowd_draw() to fill and stroke */
+static void guy__body_subpath(NVGcontext* vg)
+{
+	const float x = 0;
+	const float y = 10;
+	const float x1 = 5;
+	const float y1 = -5;
+	const float x2 = 14;
+	const float y2 = 10;
+	const float x3 = 10;
+	const float y3 = 20;
+
+	nvgMoveTo(vg, x, y);
+	nvgBezierTo(vg, x+x1, y+y1, x+x2, y+y2, x+x3, y+y3);
+	nvgLineTo(vg, -10, 30);
+	nvgBezierTo(vg, x-x2, y+y2, x-x1, y+y1, x, y);
+	nvgClosePath(vg);
+}
+
+/* tilts the head about its bottom; the head and eyes are drawn in this
+ * transform */
+static void guy__head_transform(NVGcontext* vg, float head_tilt)
+{
+	nvgTranslate(vg, 0, GUY_HEAD_R);
+	nvgRotate(vg, head_tilt);
+	nvgTranslate(vg, 0, -GUY_HEAD_R);
+}
+
+static void guy__eye_subpaths(NVGcontext* vg, const struct guy* guy)
+{
+	const float eye_r = guy->eye_r;
+
+	float eye_left_phi = -guy->eye_spacing + guy->head_turn;
+	float eye_right_phi = guy->eye_spacing + guy->head_turn;
+
+	if (eye_left_phi > -NVG_PI/2 && eye_left_phi < NVG_PI/2) {
+		float eyex = sinf(eye_left_phi) * GUY_HEAD_R;
+		nvgEllipse(vg, eyex, -guy->head_up, eye_r, eye_r * (1.0f - guy->eye_left_blink));
+	}
+
+	if (eye_right_phi > -NVG_PI/2 && eye_right_phi < NVG_PI/2) {
+		float eyex = sinf(eye_right_phi) * GUY_HEAD_R;
+		nvgEllipse(vg, eyex, -guy->head_up, eye_r, eye_r * (1.0f - guy->eye_right_blink));
+	}
+}
+
+static void guy__fill_and_stroke(NVGcontext* vg, NVGcolor fill)
+{
+	nvgFillColor(vg, fill);
+	nvgFill(vg);
+	nvgStrokeColor(vg, nvgRGBA(0,0,0,255));
+	nvgStrokeWidth(vg, 2);
+	nvgStroke(vg);
+}
+
+#define GUY_BODY_COLOR nvgRGBA(0,50,150,255)
+#define GUY_HEAD_COLOR nvgRGBA(240,120,100,255)
+#define GUY_EYE_COLOR nvgRGBA(0,0,0,255)
+
+/* points in a uniform grid, hashed into buckets and rebuilt from scratch
+ * by a counting sort. cell_size is the largest query radius, so a query
+ * only visits the 3×3 cells around it. Points are copied in, so the
+ * arrays they came from may change while the grid is queried */
+struct grid {
+	float cell_size;
+	int n_points;
+	int max_points;
+	int n_buckets; // a power of two
+	struct arena arena;
+
+	int* point_buckets;
+	// points in bucket b are [bucket_offsets[b];bucket_offsets[b+1])
+	int* bucket_offsets;
+	float* xs;
+	float* ys;
+	int* indices; // into the arrays given to grid_build()
+};
+
+static void grid__layout(struct grid* g, struct arena* a)
+{
+	const int n = g->max_points;
+	g->point_buckets = arena_alloc(a, n, sizeof *g->point_buckets);
+	g->bucket_offsets = arena_alloc(a, g->n_buckets+1, sizeof *g->bucket_offsets);
+	g->xs = arena_alloc(a, n, sizeof *g->xs);
+	g->ys = arena_alloc(a, n, sizeof *g->ys);
+	g->indices = arena_alloc(a, n, sizeof *g->indices);
+}
+
+static void grid_init(struct grid* g, int max_points, float cell_size)
+{
+	memset(g, 0, sizeof *g);
+	g->cell_size = cell_size;
+	g->max_points = max_points;
+	/* about half the buckets are empty, which keeps collisions rare */
+	g->n_buckets = 1;
+	while (g->n_buckets < 2*max_points) g->n_buckets <<= 1;
+	struct arena measure = {0};
+	grid__layout(g, &measure);
+	arena_init(&g->arena, measure.used);
+	grid__layout(g, &g->arena);
+}
+
+static void grid_free(struct grid* g)
+{
+	arena_free(&g->arena);
+	memset(g, 0, sizeof *g);
+}
+
+static inline int grid__cell(const struct grid* g, float v)
+{
+	return (int)floorf(v / g->cell_size);
+}
+
+static inline int grid__bucket(const struct grid* g, int cx, int cy)
+{
+	return (int)(((uint32_t)cx * 73856093u ^ (uint32_t)cy * 19349663u) & (uint32_t)(g->n_buckets-1));
+}
+
+static void grid_build(struct grid* g, const float* xs, const float* ys, int n)
+{
+	assert(n <= g->max_points);
+	g->n_points = n;
+	int* offsets = g->bucket_offsets;
+	memset(offsets, 0, (g->n_buckets+1) * sizeof *offsets);
+	for (int i = 0; i < n; i++) {
+		const int b = grid__bucket(g, grid__cell(g, xs[i]), grid__cell(g, ys[i]));
+		g->point_buckets[i] = b;
+		offsets[b]++;
+	}
+	/* offsets become bucket ends, and the backwards scatter moves them to
+	 * the bucket starts while keeping points in index order */
+	for (int b = 1; b < g->n_buckets; b++) offsets[b] += offsets[b-1];
+	offsets[g->n_buckets] = n;
+	for (int i = n-1; i >= 0; i--) {
+		const int slot = --offsets[g->point_buckets[i]];
+		g->xs[slot] = xs[i];
+		g->ys[slot] = ys[i];
+		g->indices[slot] = i;
+	}
+}
+
+/* index of the point nearest to x,y within r (at most cell_size), other
+ * than point skip; the lowest index on ties, and -1 if there is none. The
+ * point's position goes to out_x,out_y */
+static int grid_nearest(const struct grid* g, float x, float y, float r, int skip, float* out_x, float* out_y)
+{
+	assert(r <= g->cell_size);
+	const int cx = grid__cell(g, x);
+	const int cy = grid__cell(g, y);
+	/* squared distances to the cell's sides; a neighbour cell is skipped
+	 * if it is further away than the best point so far */
+	const float cs = g->cell_size;
+	const float side_dsqr[2][3] = {
+		{(x - cx*cs)*(x - cx*cs), 0.0f, ((cx+1)*cs - x)*((cx+1)*cs - x)},
+		{(y - cy*cs)*(y - cy*cs), 0.0f, ((cy+1)*cs - y)*((cy+1)*cs - y)},
+	};
+	float best_dsqr = r*r;
+	int best = -1;
+	int best_slot = -1;
+	/* own cell first, as it most likely has the nearest point */
+	for (int n = 4; n < 13; n++) {
+		const int dx = n%3 - 1;
+		const int dy = n/3%3 - 1;
+		if (side_dsqr[0][dx+1] + side_dsqr[1][dy+1] > best_dsqr) continue;
+		/* buckets also hold points of colliding cells, which are found
+		 * through their own buckets too */
+		const int b = grid__bucket(g, cx+dx, cy+dy);
+		for (int k = g->bucket_offsets[b]; k < g->bucket_offsets[b+1]; k++) {
+			const int index = g->indices[k];
+			if (index == skip) continue;
+			const float ddx = g->xs[k] - x;
+			const float ddy = g->ys[k] - y;
+			const float dsqr = ddx*ddx + ddy*ddy;
+			if (dsqr < best_dsqr || (dsqr == best_dsqr && best >= 0 && index < best)) {
+				best_dsqr = dsqr;
+				best = index;
+				best_slot = k;
+			}
+		}
+	}
+	if (best >= 0) {
+		*out_x = g->xs[best_slot];
+		*out_y = g->ys[best_slot];
+	}
+	return best;
+}
+
+/* many guys as structure-of-arrays, so crowd_step() can move 4 at a time.
+ * Guy i steps like a struct guy under guy_step(), except that the head
+ * bob uses crowd__sin() and the bob phase is kept in [-pi;pi) */
+struct crowd {
+	int n_guys;
+	int max_guys;
+	struct arena arena;
+
+	// walk
+	float* x;
+	float* y;
+	float* target_x;
+	float* target_y;
+	float* head_tilt;
+	float* head_bob_phi;
+
+	// look at
+	float* lookat_x;
+	float* lookat_y;
+	int* lookat_on; // ~0 to look at lookat_x/y, 0 to look nowhere
+	float* head_turn;
+	float* head_up;
+
+	// blink; both eyes always blink together
+	float* eye_blink;
+	int* blink_timer;
+	uint32_t* rng;
+
+	// state before the last step, which crowd_draw() interpolates from
+	float* prev_x;
+	float* prev_y;
+	float* prev_head_tilt;
+	float* prev_head_turn;
+	float* prev_head_up;
+	float* prev_eye_blink;
+
+	// guy i is seeded with seed+i
+	uint32_t seed;
+
+	// see crowd_set_lookat_grid()
+	const struct grid* lookat_grid;
+	int lookat_grid_is_crowd;
+};
+
+#define CROWD_SPEED (2.0f)
+#define CROWD_LOOKAT_MAX (100.0f)
+#define CROWD_LOOKAT_EASE (20.0f)
+#define CROWD_BLINK_DURATION (10)
+
+static void crowd__layout(struct crowd* c, struct arena* a)
+{
+	const int n = c->max_guys;
+	c->x = arena_alloc(a, n, sizeof *c->x);
+	c->y = arena_alloc(a, n, sizeof *c->y);
+	c->target_x = arena_alloc(a, n, sizeof *c->target_x);
+	c->target_y = arena_alloc(a, n, sizeof *c->target_y);
+	c->head_tilt = arena_alloc(a, n, sizeof *c->head_tilt);
+	c->head_bob_phi = arena_alloc(a, n, sizeof *c->head_bob_phi);
+	c->lookat_x = arena_alloc(a, n, sizeof *c->lookat_x);
+	c->lookat_y = arena_alloc(a, n, sizeof *c->lookat_y);
+	c->lookat_on = arena_alloc(a, n, sizeof *c->lookat_on);
+	c->head_turn = arena_alloc(a, n, sizeof *c->head_turn);
+	c->head_up = arena_alloc(a, n, sizeof *c->head_up);
+	c->eye_blink = arena_alloc(a, n, sizeof *c->eye_blink);
+	c->blink_timer = arena_alloc(a, n, sizeof *c->blink_timer);
+	c->rng = arena_alloc(a, n, sizeof *c->rng);
+	c->prev_x = arena_alloc(a, n, sizeof *c->prev_x);
+	c->prev_y = arena_alloc(a, n, sizeof *c->prev_y);
+	c->prev_head_tilt = arena_alloc(a, n, sizeof *c->prev_head_tilt);
+	c->prev_head_turn = arena_alloc(a, n, sizeof *c->prev_head_turn);
+	c->prev_head_up = arena_alloc(a, n, sizeof *c->prev_head_up);
+	c->prev_eye_blink = arena_alloc(a, n, sizeof *c->prev_eye_blink);
+}
+
+static void crowd_init(struct crowd* c, int max_guys, uint32_t seed)
+{
+	memset(c, 0, sizeof *c);
+	c->max_guys = max_guys;
+	c->seed = seed;
+	struct arena measure = {0};
+	crowd__layout(c, &measure);
+	arena_init(&c->arena, measure.used);
+	crowd__layout(c, &c->arena);
+}
+
+static void crowd_free(struct crowd* c)
+{
+	arena_free(&c->arena);
+	memset(c, 0, sizeof *c);
+}
+
+static void crowd__set_blink_timer(struct crowd* c, int i)
+{
+	c->blink_timer[i] = 100 + rng_range(&c->rng[i], 300);
+}
+
+/* adds a guy standing at x,y (as guy_init() with seed+i does at 100,100);
+ * returns its index i */
+static int crowd_add(struct crowd* c, float x, float y)
+{
+	if (c->n_guys >= c->max_guys) {
+		fprintf(stderr, "crowd full (%d guys)\n", c->max_guys);
+		abort();
+	}
+	const int i = c->n_guys++;
+	c->x[i] = x;
+	c->y[i] = y;
+	c->target_x[i] = x;
+	c->target_y[i] = y;
+	c->prev_x[i] = x;
+	c->prev_y[i] = y;
+	c->rng[i] = rng_seed(c->seed + (uint32_t)i);
+	c->lookat_on[i] = ~0; /* at 0,0, like a fresh struct guy */
+	crowd__set_blink_timer(c, i);
+	return i;
+}
+
+static void crowd_set_target(struct crowd* c, int i, float x, float y)
+{
+	c->target_x[i] = x;
+	c->target_y[i] = y;
+}
+
+static void crowd_lookat(struct crowd* c, int i, float x, float y)
+{
+	c->lookat_x[i] = x;
+	c->lookat_y[i] = y;
+	c->lookat_on[i] = ~0;
+}
+
+static void crowd_lookat_nowhere(struct crowd* c, int i)
+{
+	c->lookat_on[i] = 0;
+}
+
+/* from now on every step first points each guy's lookat at the nearest
+ * point of grid within CROWD_LOOKAT_MAX, or nowhere (as
+ * crowd_lookat_nowhere()) if there is none. With is_crowd the grid was
+ * built from this crowd's positions, and guys don't pick themselves. The
+ * grid must be left alone while a step runs; NULL goes back to
+ * crowd_lookat() */
+static void crowd_set_lookat_grid(struct crowd* c, const struct grid* grid, int is_crowd)
+{
+	assert(grid == NULL || grid->cell_size >= CROWD_LOOKAT_MAX);
+	c->lookat_grid = grid;
+	c->lookat_grid_is_crowd = is_crowd;
+}
+
+/* copies guy i out as a struct guy */
+static void crowd_get_guy(const struct crowd* c, int i, struct guy* guy)
+{
+	memset(guy, 0, sizeof *guy);
+	guy->eye_spacing = 0.5;
+	guy->eye_r = 1.8;
+	guy->x = c->x[i];
+	guy->y = c->y[i];
+	guy->target_x = c->target_x[i];
+	guy->target_y = c->target_y[i];
+	guy->eye_left_blink = c->eye_blink[i];
+	guy->eye_right_blink = c->eye_blink[i];
+	guy->blink_timer = c->blink_timer[i];
+	guy->head_tilt = c->head_tilt[i];
+	guy->head_up = c->head_up[i];
+	guy->head_turn = c->head_turn[i];
+	guy->head_bob_phi = c->head_bob_phi[i];
+	guy->lookat_x = c->lookat_x[i];
+	guy->lookat_y = c->lookat_y[i];
+	if (!c->lookat_on[i]) {
+		/* a struct guy can't look nowhere; its own position is what
+		 * comes closest, until it walks */
+		guy->lookat_x = guy->x;
+		guy->lookat_y = guy->y;
+	}
+	guy->rng = c->rng[i];
+}
+
+/* sin(x) for x in [-pi;pi): folded into [-pi/2;pi/2] and evaluated as a
+ * Taylor polynomial (error below 1e-6). crowd__sin4() does the same
+ * operations lane-wise, so both give the same bits */
+#define CROWD_SIN_C3 (-1.0f/6.0f)
+#define CROWD_SIN_C5 (1.0f/120.0f)
+#define CROWD_SIN_C7 (-1.0f/5040.0f)
+#define CROWD_SIN_C9 (1.0f/362880.0f)
+#define CROWD_SIN_C11 (-1.0f/39916800.0f)
+
+static inline float crowd__sin(float x)
+{
+	const float half_pi = NVG_PI*0.5f;
+	if (x > half_pi) x = NVG_PI - x;
+	if (x < -half_pi) x = -NVG_PI - x;
+	const float x2 = x*x;
+	float p = CROWD_SIN_C11;
+	p = p*x2 + CROWD_SIN_C9;
+	p = p*x2 + CROWD_SIN_C7;
+	p = p*x2 + CROWD_SIN_C5;
+	p = p*x2 + CROWD_SIN_C3;
+	p = p*x2 + 1.0f;
+	return p*x;
+}
+
+static inline float crowd__wrap_phi(float phi)
+{
+	return phi >= NVG_PI ? phi - 2.0f*NVG_PI : phi;
+}
+
+/* guy_step() for guy i; also the remainder of the SIMD loop */
+static void crowd__step_one(struct crowd* c, int i)
+{
+	c->prev_x[i] = c->x[i];
+	c->prev_y[i] = c->y[i];
+	c->prev_head_tilt[i] = c->head_tilt[i];
+	c->prev_head_turn[i] = c->head_turn[i];
+	c->prev_head_up[i] = c->head_up[i];
+	c->prev_eye_blink[i] = c->eye_blink[i];
+
+	int is_walking = 0;
+	{
+		const float dx = c->target_x[i] - c->x[i];
+		const float dy = c->target_y[i] - c->y[i];
+		const float dsqr = dx*dx + dy*dy;
+		if (dsqr > 0.01f) {
+			const float d = sqrtf(dsqr);
+			const float udx = dx / d;
+			const float udy = dy / d;
+			const float speed = d < CROWD_SPEED ? d : CROWD_SPEED;
+			c->x[i] += udx * speed;
+			c->y[i] += udy * speed;
+			const float tilt = crowd__sin(c->head_bob_phi[i]) * 0.15f;
+			c->head_tilt[i] = tilt;
+			c->head_turn[i] = tilt + udx * 0.5f;
+			c->head_bob_phi[i] = crowd__wrap_phi(c->head_bob_phi[i] + 0.3f);
+			is_walking = 1;
+		} else {
+			c->head_tilt[i] = 0.0f;
+			c->head_turn[i] = 0.0f;
+			c->head_bob_phi[i] = 0.0f;
+		}
+	}
+
+	{
+		const float dx = c->lookat_x[i] - c->x[i];
+		const float dy = c->lookat_y[i] - c->y[i];
+		const float dsqr = dx*dx + dy*dy;
+		if (c->lookat_on[i] && dsqr > 0.0f && dsqr < CROWD_LOOKAT_MAX*CROWD_LOOKAT_MAX) {
+			const float d = sqrtf(dsqr);
+			const float udx = dx / d;
+			const float udy = dy / d;
+			const float s = d < CROWD_LOOKAT_EASE ? d / CROWD_LOOKAT_EASE : 1.0f;
+			c->head_turn[i] = udx * 0.6f * s;
+			c->head_up[i] = udy * -5.0f * s;
+		} else {
+			if (!is_walking) c->head_turn[i] = 0.0f;
+			c->head_up[i] = 0.0f;
+		}
+	}
+
+	{
+		const int timer = --c->blink_timer[i];
+		if (timer < 0) {
+			const float blink_t = (float)-timer / (float)CROWD_BLINK_DURATION;
+			c->eye_blink[i] = blink_t < 0.5f ? (blink_t*2.0f) : 1.0f - (blink_t - 0.5f)*2.0f;
+			if (timer < -CROWD_BLINK_DURATION) crowd__set_blink_timer(c, i);
+		} else {
+			c->eye_blink[i] = 0.0f;
+		}
+	}
+}
+
+#if defined(__SSE2__)
+static inline __m128 crowd__select4(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline __m128 crowd__sin4(__m128 x)
+{
+	const __m128 half_pi = _mm_set1_ps(NVG_PI*0.5f);
+	const __m128 neg_half_pi = _mm_set1_ps(-NVG_PI*0.5f);
+	x = crowd__select4(_mm_cmpgt_ps(x, half_pi), _mm_sub_ps(_mm_set1_ps(NVG_PI), x), x);
+	x = crowd__select4(_mm_cmplt_ps(x, neg_half_pi), _mm_sub_ps(_mm_set1_ps(-NVG_PI), x), x);
+	const __m128 x2 = _mm_mul_ps(x, x);
+	__m128 p = _mm_set1_ps(CROWD_SIN_C11);
+	p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(CROWD_SIN_C9));
+	p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(CROWD_SIN_C7));
+	p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(CROWD_SIN_C5));
+	p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(CROWD_SIN_C3));
+	p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(1.0f));
+	return _mm_mul_ps(p, x);
+}
+#endif
+
+/* advances guys [begin;end) by one step. The SSE2 path runs the walking
+ * and standing (and looking/not looking, blinking/not blinking) cases of
+ * crowd__step_one() on 4 guys at once and picks per lane with masks;
+ * lanes that divide by zero are never picked. Only the rare blink timer
+ * reset is scalar, and the lookat grid query, if any, which comes first */
+static void crowd__step_range(struct crowd* c, int begin, int end)
+{
+	const int n = end;
+	int i = begin;
+
+	if (c->lookat_grid != NULL) {
+		for (int k = begin; k < end; k++) {
+			const int nearest = grid_nearest(c->lookat_grid, c->x[k], c->y[k], CROWD_LOOKAT_MAX, c->lookat_grid_is_crowd ? k : -1, &c->lookat_x[k], &c->lookat_y[k]);
+			c->lookat_on[k] = (nearest >= 0) ? ~0 : 0;
+		}
+	}
+
+	#if defined(__SSE2__)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 two = _mm_set1_ps(2.0f);
+		const __m128 walk_min = _mm_set1_ps(0.01f);
+		const __m128 speed_max = _mm_set1_ps(CROWD_SPEED);
+		const __m128 lookat_max = _mm_set1_ps(CROWD_LOOKAT_MAX*CROWD_LOOKAT_MAX);
+		const __m128 ease = _mm_set1_ps(CROWD_LOOKAT_EASE);
+		const __m128 bob_step = _mm_set1_ps(0.3f);
+		const __m128 pi = _mm_set1_ps(NVG_PI);
+		const __m128 two_pi = _mm_set1_ps(2.0f*NVG_PI);
+		const __m128 blink_duration = _mm_set1_ps((float)CROWD_BLINK_DURATION);
+		const __m128i blink_end = _mm_set1_epi32(-CROWD_BLINK_DURATION);
+		for (; i+4 <= n; i += 4) {
+			/* walk */
+			__m128 x = _mm_loadu_ps(c->x+i);
+			__m128 y = _mm_loadu_ps(c->y+i);
+			const __m128 phi = _mm_loadu_ps(c->head_bob_phi+i);
+			_mm_storeu_ps(c->prev_x+i, x);
+			_mm_storeu_ps(c->prev_y+i, y);
+			_mm_storeu_ps(c->prev_head_tilt+i, _mm_loadu_ps(c->head_tilt+i));
+			_mm_storeu_ps(c->prev_head_turn+i, _mm_loadu_ps(c->head_turn+i));
+			_mm_storeu_ps(c->prev_head_up+i, _mm_loadu_ps(c->head_up+i));
+			_mm_storeu_ps(c->prev_eye_blink+i, _mm_loadu_ps(c->eye_blink+i));
+			const __m128 dx = _mm_sub_ps(_mm_loadu_ps(c->target_x+i), x);
+			const __m128 dy = _mm_sub_ps(_mm_loadu_ps(c->target_y+i), y);
+			const __m128 dsqr = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+			const __m128 walking = _mm_cmpgt_ps(dsqr, walk_min);
+			const __m128 d = _mm_sqrt_ps(dsqr);
+			const __m128 udx = _mm_div_ps(dx, d);
+			const __m128 udy = _mm_div_ps(dy, d);
+			const __m128 speed = _mm_min_ps(d, speed_max);
+			x = _mm_add_ps(x, _mm_and_ps(walking, _mm_mul_ps(udx, speed)));
+			y = _mm_add_ps(y, _mm_and_ps(walking, _mm_mul_ps(udy, speed)));
+			const __m128 tilt = _mm_and_ps(walking, _mm_mul_ps(crowd__sin4(phi), _mm_set1_ps(0.15f)));
+			__m128 turn = _mm_and_ps(walking, _mm_add_ps(tilt, _mm_mul_ps(udx, half)));
+			__m128 next_phi = _mm_add_ps(phi, bob_step);
+			next_phi = _mm_sub_ps(next_phi, _mm_and_ps(_mm_cmpge_ps(next_phi, pi), two_pi));
+			_mm_storeu_ps(c->x+i, x);
+			_mm_storeu_ps(c->y+i, y);
+			_mm_storeu_ps(c->head_tilt+i, tilt);
+			_mm_storeu_ps(c->head_bob_phi+i, _mm_and_ps(walking, next_phi));
+
+			/* look at */
+			const __m128 lx = _mm_sub_ps(_mm_loadu_ps(c->lookat_x+i), x);
+			const __m128 ly = _mm_sub_ps(_mm_loadu_ps(c->lookat_y+i), y);
+			const __m128 lsqr = _mm_add_ps(_mm_mul_ps(lx, lx), _mm_mul_ps(ly, ly));
+			const __m128 on = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(c->lookat_on+i)));
+			const __m128 looking = _mm_and_ps(on, _mm_and_ps(_mm_cmpgt_ps(lsqr, zero), _mm_cmplt_ps(lsqr, lookat_max)));
+			const __m128 ld = _mm_sqrt_ps(lsqr);
+			const __m128 ludx = _mm_div_ps(lx, ld);
+			const __m128 ludy = _mm_div_ps(ly, ld);
+			const __m128 s = crowd__select4(_mm_cmplt_ps(ld, ease), _mm_div_ps(ld, ease), one);
+			turn = crowd__select4(looking, _mm_mul_ps(_mm_mul_ps(ludx, _mm_set1_ps(0.6f)), s), turn);
+			const __m128 up = _mm_and_ps(looking, _mm_mul_ps(_mm_mul_ps(ludy, _mm_set1_ps(-5.0f)), s));
+			_mm_storeu_ps(c->head_turn+i, turn);
+			_mm_storeu_ps(c->head_up+i, up);
+
+			/* blink */
+			const __m128i timer = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(c->blink_timer+i)), _mm_set1_epi32(1));
+			const __m128 blinking = _mm_castsi128_ps(_mm_cmplt_epi32(timer, _mm_setzero_si128()));
+			const __m128 blink_t = _mm_div_ps(_mm_cvtepi32_ps(_mm_sub_epi32(_mm_setzero_si128(), timer)), blink_duration);
+			const __m128 blink = crowd__select4(_mm_cmplt_ps(blink_t, half),
+				_mm_mul_ps(blink_t, two),
+				_mm_sub_ps(one, _mm_mul_ps(_mm_sub_ps(blink_t, half), two)));
+			_mm_storeu_ps(c->eye_blink+i, _mm_and_ps(blinking, blink));
+			_mm_storeu_si128((__m128i*)(c->blink_timer+i), timer);
+			int reset = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(timer, blink_end)));
+			for (int k = 0; reset; k++, reset >>= 1) {
+				if (reset & 1) crowd__set_blink_timer(c, i+k);
+			}
+		}
+	}
+	#endif
+
+	/* scalar fallback, and remainder of the SIMD loop */
+	for (; i < n; i++) crowd__step_one(c, i);
+}
+
+static void crowd_step(struct crowd* c)
+{
+	crowd__step_range(c, 0, c->n_guys);
+}
+
+/* guys per job of crowd_step_start(); a multiple of 4 so only the last
+ * chunk has a scalar remainder */
+#define CROWD_STEP_CHUNK (1024)
+
+static void crowd__step_job(void* usr, int job_index, int thread_index)
+{
+	struct crowd* c = usr;
+	const int begin = job_index * CROWD_STEP_CHUNK;
+	const int end = begin + CROWD_STEP_CHUNK < c->n_guys ? begin + CROWD_STEP_CHUNK : c->n_guys;
+	crowd__step_range(c, begin, end);
+}
+
+/* crowd_step() in chunks on pool; the crowd must be left alone until
+ * pool_wait(). Guys are independent (see rng_next()), so the result is
+ * the same as crowd_step()'s */
+static void crowd_step_start(struct crowd* c, struct pool* pool)
+{
+	pool_start(pool, (c->n_guys + CROWD_STEP_CHUNK-1) / CROWD_STEP_CHUNK, crowd__step_job, c);
+}
+
+static inline float lerpf(float a, float b, float t)
+{
+	return a + (b - a)*t;
+}
+
+/* guy i as drawn at t between the state before the last step (0) and
+ * after it (1) */
+static void crowd__lerp_guy(const struct crowd* c, int i, float t, struct guy* guy)
+{
+	crowd_get_guy(c, i, guy);
+	guy->x = lerpf(c->prev_x[i], c->x[i], t);
+	guy->y = lerpf(c->prev_y[i], c->y[i], t);
+	guy->head_tilt = lerpf(c->prev_head_tilt[i], c->head_tilt[i], t);
+	guy->head_turn = lerpf(c->prev_head_turn[i], c->head_turn[i], t);
+	guy->head_up = lerpf(c->prev_head_up[i], c->head_up[i], t);
+	guy->eye_left_blink = guy->eye_right_blink = lerpf(c->prev_eye_blink[i], c->eye_blink[i], t);
+}
+
+/* draws every guy at t (see crowd__lerp_guy()) with 5 fills and strokes
+ * in total, however many there are: all bodies are subpaths of one path,
+ * then all heads, then all eyes. nanovg transforms points as they are
+ * added, so every guy's subpaths still get its own transform. Since parts
+ * are layered by kind rather than by guy, no body covers another guy's
+ * head, and the outlines of overlapping guys are stroked across each
+ * other */
+static void crowd_draw(const struct crowd* c, NVGcontext* vg, float t)
+{
+	const int n = c->n_guys;
+
+	nvgBeginPath(vg);
+	for (int i = 0; i < n; i++) {
+		nvgSave(vg);
+		nvgTranslate(vg, lerpf(c->prev_x[i], c->x[i], t), lerpf(c->prev_y[i], c->y[i], t));
+		guy__body_subpath(vg);
+		nvgRestore(vg);
+	}
+	guy__fill_and_stroke(vg, GUY_BODY_COLOR);
+
+	nvgBeginPath(vg);
+	for (int i = 0; i < n; i++) {
+		nvgSave(vg);
+		nvgTranslate(vg, lerpf(c->prev_x[i], c->x[i], t), lerpf(c->prev_y[i], c->y[i], t));
+		guy__head_transform(vg, lerpf(c->prev_head_tilt[i], c->head_tilt[i], t));
+		nvgCircle(vg, 0, 0, GUY_HEAD_R);
+		nvgRestore(vg);
+	}
+	guy__fill_and_stroke(vg, GUY_HEAD_COLOR);
+
+	nvgBeginPath(vg);
+	for (int i = 0; i < n; i++) {
+		struct guy guy;
+		crowd__lerp_guy(c, i, t, &guy);
+		nvgSave(vg);
+		nvgTranslate(vg, guy.x, guy.y);
+		guy__head_transform(vg, guy.head_tilt);
+		guy__eye_subpaths(vg, &guy);
+		nvgRestore(vg);
+	}
+	nvgFillColor(vg, GUY_EYE_COLOR);
+	nvgFill(vg);
+}
+
+#ifndef SIM_HZ
+/* simulation steps per second; speeds in crowd_step() and of the hat are
+ * per step */
+#define SIM_HZ (60)
+#endif
+/* after a stall the simulation slows down rather than catching up with
+ * ever more steps per frame */
+#define SIM_MAX_STEPS_PER_FRAME (8)
+
+static double seconds_since(Uint64 t0)
+{
+	return (double)(SDL_GetPerformanceCounter() - t0) / (double)SDL_GetPerformanceFrequency();
+}
+
+static void bench_math()
+{
+	/* throughput of the m33 kernels; m33_apply_batch() must match
+	 * m33_apply() to the bit */
+	const int n_vertices = 1 << 20;
+	const int n_runs = 20;
+	const int n_matrices = 1 << 22;
+	union v3* in = xcalloc(n_vertices, sizeof *in);
+	union v3* out_ref = xcalloc(n_vertices, sizeof *out_ref);
+	union v3* out = xcalloc(n_vertices, sizeof *out);
+	for (int i = 0; i < n_vertices; i++) {
+		for (int k = 0; k < 3; k++) in[i].s[k] = (float)((i*7 + k*13) % 1000) * 0.1f - 50.0f;
+	}
+	union m33 tx, ty;
+	m33_set_rotate(&tx, 0.3f, v3_axis_x());
+	m33_set_rotate(&ty, 1.1f, v3_axis_y());
+	m33_multiply_inplace(&tx, &ty);
+
+	Uint64 t0 = SDL_GetPerformanceCounter();
+	for (int run = 0; run < n_runs; run++) {
+		for (int i = 0; i < n_vertices; i++) out_ref[i] = m33_apply(&tx, in[i]);
+	}
+	const double dt_apply = seconds_since(t0);
+	t0 = SDL_GetPerformanceCounter();
+	for (int run = 0; run < n_runs; run++) m33_apply_batch(&tx, in, out, n_vertices);
+	const double dt_batch = seconds_since(t0);
+	if (memcmp(out, out_ref, n_vertices * sizeof *out) != 0) {
+		fprintf(stderr, "m33_apply_batch() differs from m33_apply()\n");
+		abort();
+	}
+
+	/* independent products, so this is throughput, not latency */
+	union m33 ms[256];
+	for (int i = 0; i < 256; i++) m33_set_rotate(&ms[i], i * 0.01f, v3_axis_y());
+	float sum = 0.0f;
+	t0 = SDL_GetPerformanceCounter();
+	for (int i = 0; i < n_matrices; i++) {
+		union m33 r;
+		m33_multiply(&r, &ms[i & 255], &tx);
+		sum += r.s[i % 9];
+	}
+	const double dt_multiply = seconds_since(t0);
+
+	t0 = SDL_GetPerformanceCounter();
+	for (int i = 0; i < n_matrices; i++) {
+		union m33 r;
+		m33_set_rotate(&r, i * 1e-3f, v3_axis_z());
+		sum += r.s[1];
+	}
+	const double dt_rotate = seconds_since(t0);
+
+	const char* kernel =
+	#if defined(__SSE2__)
+		"sse2";
+	#else
+		"scalar";
+	#endif
+	const double n_applied = (double)n_vertices * (double)n_runs;
+	printf("%-22s %10.1f M/s\n", "m33_apply", n_applied / dt_apply * 1e-6);
+	printf("%-22s %10.1f M/s (%s)\n", "m33_apply_batch", n_applied / dt_batch * 1e-6, kernel);
+	printf("%-22s %10.1f M/s\n", "m33_multiply", n_matrices / dt_multiply * 1e-6);
+	printf("%-22s %10.1f M/s\n", "m33_set_rotate", n_matrices / dt_rotate * 1e-6);
+	printf("(checksum %g)\n", sum);
+	free(in);
+	free(out_ref);
+	free(out);
+}
+
+static void bench_prep()
+{
+	/* outline_prep() time for increasingly finer hats; time per vertex
+	 * should stay roughly flat */
+	const int sizes[][2] = {{12,32}, {24,64}, {48,128}, {96,256}, {192,512}, {384,1024}};
+	const int n_sizes = sizeof sizes / sizeof sizes[0];
+	printf("%10s %10s %10s %12s %12s\n", "vertices", "polygons", "edges", "prep ms", "ns/vertex");
+	for (int i = 0; i < n_sizes; i++) {
+		struct outline o;
+		Uint64 t0 = SDL_GetPerformanceCounter();
+		outline_init_hat(&o, sizes[i][0], sizes[i][1]);
+		double dt = seconds_since(t0);
+		printf("%10d %10d %10d %12.3f %12.1f\n",
+			o.n_vertices, o.n_polygons, o.n_edges,
+			dt * 1e3, dt * 1e9 / (double)o.n_vertices);
+		outline_free(&o);
+	}
+}
+
+/* a fresh, unprepped outline with the specified arrays of src */
+static void bench_prep_parallel__copy(struct outline* dst, const struct outline* src)
+{
+	outline_alloc(dst, src->n_vertices, src->n_polygons, src->n_halfedges);
+	memcpy(dst->vertices, src->vertices, src->n_vertices * sizeof *src->vertices);
+	memcpy(dst->polygon_materials, src->polygon_materials, src->n_polygons * sizeof *src->polygon_materials);
+	memcpy(dst->polygon_lookup, src->polygon_lookup, src->n_polygons * sizeof *src->polygon_lookup);
+	memcpy(dst->polygon_vertex_indices, src->polygon_vertex_indices, src->n_halfedges * sizeof *src->polygon_vertex_indices);
+}
+
+static void bench_prep_parallel()
+{
+	/* outline_prep_parallel() for 1 to n_cpus threads; every result must
+	 * match the serial outline_prep() byte for byte */
+	const int sizes[][2] = {{96,256}, {384,1024}, {1000,1000}};
+	const int n_sizes = sizeof sizes / sizeof sizes[0];
+	const int n_runs = 3;
+	int n_cpus = SDL_GetCPUCount();
+	if (n_cpus < 2) n_cpus = 2;
+	printf("%10s %8s %12s %12s %10s\n", "polygons", "threads", "serial ms", "parallel ms", "speedup");
+	for (int i = 0; i < n_sizes; i++) {
+		struct outline ref;
+		outline_init_hat(&ref, sizes[i][0], sizes[i][1]);
+
+		double dt_serial = 0.0;
+		for (int run = 0; run < n_runs; run++) {
+			struct outline o;
+			bench_prep_parallel__copy(&o, &ref);
+			Uint64 t0 = SDL_GetPerformanceCounter();
+			outline_prep(&o);
+			const double dt = seconds_since(t0);
+			if (run == 0 || dt < dt_serial) dt_serial = dt;
+			outline_free(&o);
+		}
+
+		for (int n_threads = 1; n_threads <= n_cpus; n_threads++) {
+			struct pool* pool = pool_create(n_threads);
+			double dt_parallel = 0.0;
+			for (int run = 0; run < n_runs; run++) {
+				struct outline o;
+				bench_prep_parallel__copy(&o, &ref);
+				Uint64 t0 = SDL_GetPerformanceCounter();
+				outline_prep_parallel(&o, pool);
+				const double dt = seconds_since(t0);
+				if (run == 0 || dt < dt_parallel) dt_parallel = dt;
+				if (o.arena.used != ref.arena.used || memcmp(o.arena.base, ref.arena.base, ref.arena.used) != 0) {
+					fprintf(stderr, "outline_prep_parallel() with %d threads differs from outline_prep()\n", n_threads);
+					abort();
+				}
+				outline_free(&o);
+			}
+			printf("%10d %8d %12.3f %12.3f %10.2f\n", ref.n_polygons, n_threads, dt_serial * 1e3, dt_parallel * 1e3, dt_serial / dt_parallel);
+			pool_destroy(pool);
+		}
+		outline_free(&ref);
+	}
+}
+
+static double bench_lod__extract(const struct outline* o, float scale, int n_frames, int* n_points)
+{
+	struct outline_scratch scratch;
+	struct outline_contours contours = {0};
+	outline_scratch_init(&scratch, o);
+	*n_points = 0;
+	Uint64 t0 = SDL_GetPerformanceCounter();
+	for (int frame = 0; frame < n_frames; frame++) {
+		union m33 tx;
+		m33_set_rotate(&tx, frame * 0.05f, v3_axis_x());
+		for (int i = 0; i < 9; i++) tx.s[i] *= scale;
+		outline_extract(o, &scratch, &tx, &contours);
+		*n_points += contours.n_points;
+	}
+	double dt = seconds_since(t0);
+	outline_scratch_free(&scratch);
+	outline_contours_free(&contours);
+	return dt / n_frames;
+}
+
+static void bench_lod()
+{
+	/* outline_prep_lods() cost and the levels it makes, then
+	 * outline_extract() of a hat drawn at shrinking sizes, with and
+	 * without the levels (the hat's radius is 100 at scale 1) */
+	struct outline o;
+	outline_init_hat(&o, 192, 512);
+	Uint64 t0 = SDL_GetPerformanceCounter();
+	outline_prep_lods(&o, 8);
+	const double dt_lods = seconds_since(t0);
+	printf("outline_prep_lods: %.3f ms\n", dt_lods * 1e3);
+	printf("%6s %10s %10s %10s %12s\n", "level", "vertices", "polygons", "materials", "error");
+	int level = 0;
+	for (const struct outline* l = &o; l != NULL; l = l->lod, level++) {
+		printf("%6d %10d %10d %10d %12.4f\n", level, l->n_vertices, l->n_polygons, l->n_materials, l->lod_error);
+	}
 
-		int jprev = n_strips-1;
-		for (int j = 0; j < n_strips; j++) {
-			float jphi = ((float)j / (float)n_strips) * NVG_PI * 2.0f;
+	const float scales[] = {4.0f, 1.0f, 0.25f, 0.0625f, 0.015625f};
+	const int n_scales = sizeof scales / sizeof scales[0];
+	const int n_frames = 50;
+	printf("%10s %14s %14s %12s %12s\n", "scale", "full us", "lod us", "full points", "lod points");
+	for (int i = 0; i < n_scales; i++) {
+		int n_points_full, n_points_lod;
+		struct outline* lods = o.lod;
+		o.lod = NULL;
+		const double dt_full = bench_lod__extract(&o, scales[i], n_frames, &n_points_full);
+		o.lod = lods;
+		const double dt_lod = bench_lod__extract(&o, scales[i], n_frames, &n_points_lod);
+		printf("%10.4f %14.1f %14.1f %12d %12d\n", scales[i], dt_full * 1e6, dt_lod * 1e6, n_points_full / n_frames, n_points_lod / n_frames);
+	}
+	outline_free(&o);
+}
 
-			// XXX choose different curve maybe?
-			v.x = sinf(jphi) * r * radius;
-			v.z = cosf(jphi) * r * radius;
+static void bench_facing()
+{
+	/* polygon facing classification on a ~1M polygon hat: the old
+	 * per-polygon v3_dot() over the AoS normals vs
+	 * outline__classify_polygons() */
+	struct outline o;
+	outline_init_hat(&o, 1000, 1000);
+	struct outline_scratch scratch;
+	outline_scratch_init(&scratch, &o);
+	const int n_iterations = 50;
+	const int n_polygons = o.n_polygons;
+
+	int n_tags_ref = 0;
+	Uint64 t0 = SDL_GetPerformanceCounter();
+	for (int it = 0; it < n_iterations; it++) {
+		union m33 tx;
+		m33_set_rotate(&tx, it * 0.1f, v3_axis_x());
+		union v3 view = m33_get_view_v3(&tx);
+		for (int i = 0; i < n_polygons; i++) {
+			int flags = 0;
+			if (o.polygon_materials[i] == 0) {
+				if (v3_dot(view, o.polygon_normals[i]) > 0.0f) {
+					flags |= DRAW;
+					n_tags_ref++;
+				}
+			}
+			scratch.polygon_flags[i] = flags;
+		}
+	}
+	double dt_ref = seconds_since(t0);
 
-			assert(vi < n_vertices);
-			o->vertices[vi] = v;
-			vi++;
+	int n_tags = 0;
+	t0 = SDL_GetPerformanceCounter();
+	for (int it = 0; it < n_iterations; it++) {
+		union m33 tx;
+		m33_set_rotate(&tx, it * 0.1f, v3_axis_x());
+		n_tags += outline__classify_polygons(&o, &scratch, m33_get_view_v3(&tx), 0);
+	}
+	double dt = seconds_since(t0);
+	if (n_tags != n_tags_ref) {
+		fprintf(stderr, "outline__classify_polygons() tagged %d polygons, the scalar loop %d\n", n_tags, n_tags_ref);
+		abort();
+	}
 
-			assert(pi < n_polygons);
-			o->polygon_materials[pi] = polygon_material;
-			o->polygon_lookup[pi].offset = pvi;
-			o->polygon_lookup[pi].length = n_polygon_sides;
-			pi++;
+	const char* kernel =
+	#if defined(__AVX2__)
+		"avx2";
+	#elif defined(__SSE2__)
+		"sse2";
+	#else
+		"scalar";
+	#endif
+	const double n_total = (double)n_polygons * (double)n_iterations;
+	printf("%d polygons, %d iterations\n", n_polygons, n_iterations);
+	printf("%-12s %10.1f Mpolygons/s\n", "aos scalar", n_total / dt_ref * 1e-6);
+	printf("%-12s %10.1f Mpolygons/s\n", kernel, n_total / dt * 1e-6);
+	outline_scratch_free(&scratch);
+	outline_free(&o);
+}
 
-			int pvi_before = pvi;
-			o->polygon_vertex_indices[pvi++] = jprev + segment_offset;
-			o->polygon_vertex_indices[pvi++] = j + segment_offset;
-			if (is_top) {
-				o->polygon_vertex_indices[pvi++] = n_vertices-1;
-			} else {
-				o->polygon_vertex_indices[pvi++] = j + segment_offset + n_strips;
-				o->polygon_vertex_indices[pvi++] = jprev + segment_offset + n_strips;
+static void bench_incremental()
+{
+	/* outline half-edge search per frame on a ~1M polygon hat, full vs
+	 * incremental, for increasing rotation steps between frames */
+	struct outline o;
+	outline_init_hat(&o, 1000, 1000);
+	struct outline_scratch scratch;
+	outline_scratch_init(&scratch, &o);
+	const float steps[] = {0.001f, 0.01f, 0.1f};
+	const int n_frames = 100;
+	printf("%d polygons\n", o.n_polygons);
+	printf("%10s %14s %14s %10s\n", "rad/frame", "full ms", "incr ms", "outline");
+	for (int i = 0; i < sizeof steps / sizeof steps[0]; i++) {
+		double dt[2];
+		int n_contour[2] = {0,0};
+		for (int incremental = 0; incremental < 2; incremental++) {
+			outline_set_incremental(&scratch, incremental);
+			union m33 tx;
+			m33_set_rotate(&tx, 0.3f, v3_axis_x());
+			const int* contour;
+			outline__find_contour(&o, &scratch, m33_get_view_v3(&tx), &contour);
+			Uint64 t0 = SDL_GetPerformanceCounter();
+			for (int frame = 1; frame <= n_frames; frame++) {
+				m33_set_rotate(&tx, 0.3f + frame * steps[i], v3_axis_x());
+				n_contour[incremental] += outline__find_contour(&o, &scratch, m33_get_view_v3(&tx), &contour);
 			}
-			assert((pvi - pvi_before) == n_polygon_sides);
-			jprev = j;
+			dt[incremental] = seconds_since(t0);
 		}
-		segment_offset += n_strips;
+		if (n_contour[0] != n_contour[1]) {
+			fprintf(stderr, "incremental outline__find_contour() found %d half-edges in all, the full search %d\n", n_contour[1], n_contour[0]);
+			abort();
+		}
+		printf("%10.3f %14.3f %14.3f %10d\n", steps[i], dt[0] * 1e3 / n_frames, dt[1] * 1e3 / n_frames, n_contour[0] / n_frames);
 	}
+	outline_scratch_free(&scratch);
+	outline_free(&o);
+}
 
-	o->vertices[vi++] = (union v3){.y = radius};
+struct bench_extract_job {
+	struct outline* outline;
+	struct outline_scratch* scratches; // one per thread
+	struct outline_contours* contours; // one per instance
+	float phi;
+};
 
-	outline_prep(o);
+static void bench_extract_job(void* usr, int job_index, int thread_index)
+{
+	struct bench_extract_job* job = usr;
+	union m33 tx, ty;
+	m33_set_rotate(&tx, job->phi + job_index * 0.1f, v3_axis_x());
+	m33_set_rotate(&ty, job_index * 0.37f, v3_axis_y());
+	m33_multiply_inplace(&tx, &ty);
+	outline_extract(job->outline, &job->scratches[thread_index], &tx, &job->contours[job_index]);
 }
 
-struct guy {
-	float eye_r;
-	float eye_spacing;
+static void bench_extract()
+{
+	/* outline_extract() of many instances of one shared mesh on a thread
+	 * pool, one job per instance and one scratch per thread, for 1 to
+	 * n_cpus threads; every instance's points must match the 1 thread
+	 * run's */
+	struct outline* o = outline_create_hat(48, 128);
+	const int n_instances = 256;
+	const int n_frames = 20;
+	int n_cpus = SDL_GetCPUCount();
+	if (n_cpus < 2) n_cpus = 2;
+	struct bench_extract_job job = {.outline = o};
+	job.scratches = xcalloc(n_cpus, sizeof *job.scratches);
+	job.contours = xcalloc(n_instances, sizeof *job.contours);
+	for (int i = 0; i < n_cpus; i++) outline_scratch_init(&job.scratches[i], o);
+	int* ref_n_points = xcalloc(n_instances, sizeof *ref_n_points);
+	float** ref_points = xcalloc(n_instances, sizeof *ref_points);
+
+	printf("%d instances of %d polygons, %d frames\n", n_instances, o->n_polygons, n_frames);
+	printf("%8s %16s %10s\n", "threads", "instances/s", "points");
+	for (int n_threads = 1; n_threads <= n_cpus; n_threads++) {
+		struct pool* pool = pool_create(n_threads);
+		Uint64 t0 = SDL_GetPerformanceCounter();
+		for (int frame = 0; frame < n_frames; frame++) {
+			job.phi = frame * 0.01f;
+			pool_run(pool, n_instances, bench_extract_job, &job);
+		}
+		double dt = seconds_since(t0);
+		int n_points = 0;
+		for (int i = 0; i < n_instances; i++) {
+			const struct outline_contours* c = &job.contours[i];
+			n_points += c->n_points;
+			const size_t sz = 2*c->n_points*sizeof *c->points;
+			if (n_threads == 1) {
+				ref_n_points[i] = c->n_points;
+				ref_points[i] = xcalloc(2*c->n_points + 1, sizeof *ref_points[i]);
+				memcpy(ref_points[i], c->points, sz);
+			} else if (c->n_points != ref_n_points[i] || memcmp(c->points, ref_points[i], sz) != 0) {
+				fprintf(stderr, "outline_extract() of instance %d with %d threads differs from 1 thread\n", i, n_threads);
+				abort();
+			}
+		}
+		printf("%8d %16.0f %10d\n", n_threads, (double)(n_instances * n_frames) / dt, n_points);
+		pool_destroy(pool);
+	}
 
-	float x;
-	float y;
-	float target_x;
-	float target_y;
-	float eye_left_blink;
-	float eye_right_blink;
-	int blink_timer;
-	float head_tilt;
-	float head_up;
-	float head_turn;
-	float head_bob_phi;
-	float lookat_x;
-	float lookat_y;
-};
+	for (int i = 0; i < n_cpus; i++) outline_scratch_free(&job.scratches[i]);
+	for (int i = 0; i < n_instances; i++) {
+		outline_contours_free(&job.contours[i]);
+		free(ref_points[i]);
+	}
+	free(ref_points);
+	free(ref_n_points);
+	free(job.scratches);
+	free(job.contours);
+	outline_release(o);
+}
 
-static void _guy_set_blink_timer(struct guy* guy)
+static void bench_path()
 {
-	guy->blink_timer = 100 + (rand() % 300);
+	/* outline_extract() of an incrementally drawn hat turning a little
+	 * every frame: without the path cache, with the exact cache (default
+	 * tolerances), and with 0.5 pixel / 0.002 radian tolerances */
+	struct outline o;
+	outline_init_hat(&o, 384, 1024);
+	const float steps[] = {0.00001f, 0.0001f, 0.001f, 0.01f};
+	const int n_steps = sizeof steps / sizeof steps[0];
+	const int n_frames = 200;
+	const char* modes[] = {"no cache", "exact", "tolerance"};
+	printf("%d polygons, %d frames\n", o.n_polygons, n_frames);
+	printf("%10s %12s %12s %12s %10s\n", "rad/frame", modes[0], modes[1], modes[2], "points");
+	for (int i = 0; i < n_steps; i++) {
+		double dt[3];
+		int n_points = 0;
+		for (int mode = 0; mode < 3; mode++) {
+			struct outline_scratch scratch;
+			struct outline_contours contours = {0};
+			outline_scratch_init(&scratch, &o);
+			outline_set_incremental(&scratch, 1);
+			if (mode == 2) outline_contours_set_tolerance(&contours, 0.5f, 0.002f);
+			union m33 tx;
+			m33_set_rotate(&tx, 0.3f, v3_axis_x());
+			outline_extract(&o, &scratch, &tx, &contours);
+			Uint64 t0 = SDL_GetPerformanceCounter();
+			for (int frame = 1; frame <= n_frames; frame++) {
+				m33_set_rotate(&tx, 0.3f + frame * steps[i], v3_axis_x());
+				if (mode == 0) contours.cache_valid = 0;
+				outline_extract(&o, &scratch, &tx, &contours);
+			}
+			dt[mode] = seconds_since(t0);
+			if (mode == 0) n_points = contours.n_points;
+			if (mode == 2) {
+				/* however small the turn per frame, the outline must be
+				 * found again once the turn adds up past the tolerance;
+				 * without the pixel tolerance, which would hide it */
+				outline_contours_set_tolerance(&contours, 0.0f, 0.002f);
+				for (int frame = 1; frame * steps[i] <= 0.004f; frame++) {
+					m33_set_rotate(&tx, 0.3f + (n_frames + frame) * steps[i], v3_axis_x());
+					outline_extract(&o, &scratch, &tx, &contours);
+				}
+				const union v3 view = m33_get_view_v3(&tx);
+				const union v3 found_view = contours.cache_found_view;
+				if (v3_dot(view, found_view) < v3_length(view) * v3_length(found_view) * cosf(0.002f)) {
+					fprintf(stderr, "tolerance cache kept an outline found more than 0.002 radians ago\n");
+					abort();
+				}
+			}
+			outline_contours_free(&contours);
+			outline_scratch_free(&scratch);
+		}
+		printf("%10.5f %12.3f %12.3f %12.3f %10d\n", steps[i], dt[0] * 1e3 / n_frames, dt[1] * 1e3 / n_frames, dt[2] * 1e3 / n_frames, n_points);
+	}
+	outline_free(&o);
 }
 
-static void guy_init(struct guy* guy)
+static double bench_load__extract(const struct outline* o)
 {
-	memset(guy, 0, sizeof *guy);
-	guy->eye_spacing = 0.5;
-	guy->eye_r = 1.8;
-	guy->head_up = 0;
-	guy->x = 100;
-	guy->y = 100;
-	guy->target_x = guy->x;
-	guy->target_y = guy->y;
-	_guy_set_blink_timer(guy);
+	struct outline_scratch scratch;
+	struct outline_contours contours = {0};
+	union m33 tx;
+	m33_set_rotate(&tx, 0.3f, v3_axis_x());
+	Uint64 t0 = SDL_GetPerformanceCounter();
+	outline_scratch_init(&scratch, o);
+	outline_extract(o, &scratch, &tx, &contours);
+	double dt = seconds_since(t0);
+	outline_scratch_free(&scratch);
+	outline_contours_free(&contours);
+	return dt;
 }
 
-static void guy_lookat(struct guy* guy, float x, float y)
+static void bench_load()
 {
-	guy->lookat_x = x;
-	guy->lookat_y = y;
+	/* startup cost: building+prepping a hat vs mapping its cache file,
+	 * alone and followed by the first extract (which touches the mapped
+	 * pages). The file was just written, so the page cache is warm */
+	const char* path = "bench_load.outline";
+	printf("%10s %8s %10s %10s %14s %14s\n", "polygons", "MB", "prep ms", "load ms", "prep+1st ms", "load+1st ms");
+	for (int n = 64; n <= 1024; n *= 2) {
+		struct outline a, b;
+		Uint64 t0 = SDL_GetPerformanceCounter();
+		outline_init_hat(&a, n, n);
+		const double dt_prep = seconds_since(t0);
+		const double dt_prep_extract = dt_prep + bench_load__extract(&a);
+		if (outline_save(&a, path) != 0) break;
+
+		t0 = SDL_GetPerformanceCounter();
+		if (outline_load(&b, path) != 0) break;
+		const double dt_load = seconds_since(t0);
+		const double dt_load_extract = dt_load + bench_load__extract(&b);
+
+		if (b.n_edges != a.n_edges || memcmp(b.halfedge_twin, a.halfedge_twin, a.n_halfedges * sizeof *a.halfedge_twin) != 0) {
+			fprintf(stderr, "outline_load() of %s differs from what was saved\n", path);
+			abort();
+		}
+		printf("%10d %8.1f %10.3f %10.3f %14.3f %14.3f\n",
+			a.n_polygons, a.arena.used / (1024.0*1024.0),
+			dt_prep * 1e3, dt_load * 1e3, dt_prep_extract * 1e3, dt_load_extract * 1e3);
+		outline_free(&a);
+		outline_free(&b);
+	}
+	remove(path);
 }
 
-static void guy_set_target(struct guy* guy, float x, float y)
+static void bench_import__write_obj(const struct outline* o, FILE* f)
 {
-	guy->target_x = x;
-	guy->target_y = y;
+	for (int i = 0; i < o->n_vertices; i++) {
+		fprintf(f, "v %.6f %.6f %.6f\n", o->vertices[i].x, o->vertices[i].y, o->vertices[i].z);
+	}
+	int material = -1;
+	for (int i = 0; i < o->n_polygons; i++) {
+		if (o->polygon_materials[i] != material) {
+			material = o->polygon_materials[i];
+			fprintf(f, "usemtl m%d\n", material);
+		}
+		fprintf(f, "f");
+		const int *begin, *end;
+		ipair_lookup(&begin, &end, o->polygon_lookup, i, o->polygon_vertex_indices);
+		for (const int* it = begin; it < end; it++) fprintf(f, " %d", *it + 1);
+		fprintf(f, "\n");
+	}
 }
 
-static void guy_step(struct guy* guy)
+static void bench_import__write_ply(const struct outline* o, FILE* f, int binary)
 {
-	int is_walking = 0;
-	{
-		float dx = guy->target_x - guy->x;
-		float dy = guy->target_y - guy->y;
-		float dsqr = dx*dx + dy*dy;
-		if (dsqr > 0.01f) {
-			float d = sqrtf(dsqr);
-			float udx = dx / d;
-			float udy = dy / d;
-			float speed = 2.0f;
-			if (d < speed) speed = d;
-			guy->x += udx * speed;
-			guy->y += udy * speed;
-			guy->head_tilt = sinf(guy->head_bob_phi) * 0.15;
-			guy->head_turn = guy->head_tilt * 1.0 + udx * 0.5;
-			guy->head_bob_phi += 0.3f;
-			is_walking = 1;
+	fprintf(f, "ply\nformat %s 1.0\n", binary ? "binary_little_endian" : "ascii");
+	fprintf(f, "element vertex %d\nproperty float x\nproperty float y\nproperty float z\n", o->n_vertices);
+	fprintf(f, "element face %d\nproperty list uchar int vertex_indices\nproperty int material_index\n", o->n_polygons);
+	fprintf(f, "end_header\n");
+	for (int i = 0; i < o->n_vertices; i++) {
+		if (binary) {
+			fwrite(&o->vertices[i], sizeof o->vertices[i], 1, f);
 		} else {
-			guy->head_tilt = 0.0f;
-			guy->head_turn = 0.0f;
-			guy->head_bob_phi = 0.0f;
+			fprintf(f, "%.6f %.6f %.6f\n", o->vertices[i].x, o->vertices[i].y, o->vertices[i].z);
 		}
 	}
+	for (int i = 0; i < o->n_polygons; i++) {
+		const union ipair lu = o->polygon_lookup[i];
+		const int* indices = &o->polygon_vertex_indices[lu.offset];
+		if (binary) {
+			const uint8_t n = lu.length;
+			fwrite(&n, 1, 1, f);
+			fwrite(indices, sizeof *indices, lu.length, f);
+			fwrite(&o->polygon_materials[i], sizeof o->polygon_materials[i], 1, f);
+		} else {
+			fprintf(f, "%d", lu.length);
+			for (int k = 0; k < lu.length; k++) fprintf(f, " %d", indices[k]);
+			fprintf(f, " %d\n", o->polygon_materials[i]);
+		}
+	}
+}
 
-	{
-		float dx = guy->lookat_x - guy->x;
-		float dy = guy->lookat_y - guy->y;
-		float dsqr = dx*dx + dy*dy;
-		const float dmax = 100.0f;
-		if (dsqr > 0 && dsqr < dmax*dmax) {
-			float d = sqrtf(dsqr);
-			float udx = dx / d;
-			float udy = dy / d;
-			float s = 1.0f;
-			const float ease_r = 20.0f;
-			if (d < ease_r) s = d / ease_r;
-			guy->head_turn = udx * 0.6 * s;
-			guy->head_up = udy * -5 * s;
+static void bench_import()
+{
+	/* import throughput of a hat written as OBJ and PLY; import is
+	 * parsing into the specified arrays, prep is reported separately */
+	const char* path = "bench_import.tmp";
+	struct outline hat;
+	outline_init_hat(&hat, 512, 1024);
+	printf("%d vertices, %d polygons\n", hat.n_vertices, hat.n_polygons);
+	printf("%-12s %8s %12s %10s %10s\n", "format", "MB", "import ms", "MB/s", "prep ms");
+	const char* formats[] = {"obj", "ply ascii", "ply binary"};
+	for (int i = 0; i < 3; i++) {
+		FILE* f = fopen(path, "wb");
+		if (f == NULL) break;
+		if (i == 0) {
+			bench_import__write_obj(&hat, f);
 		} else {
-			if (!is_walking) guy->head_turn = 0.0f;
-			guy->head_up = 0.0f;
+			bench_import__write_ply(&hat, f, i == 2);
+		}
+		const double mb = ftell(f) / (1024.0*1024.0);
+		fclose(f);
+
+		struct outline o;
+		Uint64 t0 = SDL_GetPerformanceCounter();
+		if (outline_import_specified(&o, path) != 0) break;
+		const double dt_import = seconds_since(t0);
+		struct pool* pool = pool_create(0);
+		t0 = SDL_GetPerformanceCounter();
+		outline_prep_parallel(&o, pool);
+		const double dt_prep = seconds_since(t0);
+		pool_destroy(pool);
+		if (o.n_polygons != hat.n_polygons || o.n_edges != hat.n_edges || memcmp(o.polygon_vertex_indices, hat.polygon_vertex_indices, hat.n_halfedges * sizeof *hat.polygon_vertex_indices) != 0 || memcmp(o.polygon_materials, hat.polygon_materials, hat.n_polygons * sizeof *hat.polygon_materials) != 0) {
+			fprintf(stderr, "importing the %s file gave a different mesh\n", formats[i]);
+			abort();
 		}
+		printf("%-12s %8.1f %12.3f %10.1f %10.3f\n", formats[i], mb, dt_import * 1e3, mb / dt_import, dt_prep * 1e3);
+		outline_free(&o);
 	}
+	remove(path);
+	outline_free(&hat);
+}
 
-	{
-		guy->blink_timer--;
-		if (guy->blink_timer < 0) {
-			const int blink_duration = 10;
-			float blink_t = (float)-guy->blink_timer / (float)blink_duration;
-			float blink = blink_t < 0.5f ? (blink_t*2.0f) : 1.0f - (blink_t - 0.5f)*2.0f;
-			guy->eye_left_blink = blink;
-			guy->eye_right_blink = blink;
-			if (guy->blink_timer < -blink_duration) {
-				_guy_set_blink_timer(guy);
-			}
+#define BENCH_CROWD_SEED (1)
+#define BENCH_CROWD_SLICES (64)
+
+static void bench_crowd__setup(struct crowd* c, struct guy* guys, int n_guys)
+{
+	for (int i = 0; i < n_guys; i++) {
+		const float x = (float)(i % 1000);
+		const float y = (float)(i / 1000) * 10.0f;
+		/* some arrive within the run and some don't; most look at
+		 * something near */
+		const float tx = x + (float)((i*37) % 301 - 150);
+		const float ty = y + (float)((i*91) % 301 - 150);
+		const float lx = x + (float)((i*53) % 241 - 120);
+		const float ly = y + (float)((i*29) % 241 - 120);
+		if (c != NULL) {
+			crowd_add(c, x, y);
+			crowd_set_target(c, i, tx, ty);
+			crowd_lookat(c, i, lx, ly);
 		} else {
-			guy->eye_left_blink = 0.0f;
-			guy->eye_right_blink = 0.0f;
+			struct guy* guy = &guys[i];
+			guy_init(guy, BENCH_CROWD_SEED + i);
+			guy->x = guy->target_x = x;
+			guy->y = guy->target_y = y;
+			guy_set_target(guy, tx, ty);
+			guy_lookat(guy, lx, ly);
 		}
 	}
 }
 
-static void guy_draw(struct guy* guy, NVGcontext* vg)
+struct bench_crowd_job {
+	struct guy* guys;
+	int n_guys;
+};
+
+static void bench_crowd_job(void* usr, int job_index, int thread_index)
 {
-	nvgSave(vg);
+	struct bench_crowd_job* job = usr;
+	const int begin = (int)((int64_t)job->n_guys * job_index / BENCH_CROWD_SLICES);
+	const int end = (int)((int64_t)job->n_guys * (job_index+1) / BENCH_CROWD_SLICES);
+	for (int i = begin; i < end; i++) guy_step(&job->guys[i]);
+}
 
-	nvgTranslate(vg, guy->x, guy->y);
+static void bench_crowd()
+{
+	/* update time per guy for guy_step() on an array of struct guy, on
+	 * one thread and in slices on a pool, and for a struct crowd stepped
+	 * one guy at a time and by crowd_step(). Every guy has its own random
+	 * stream, so the two guy_step() runs and the two crowd runs must agree
+	 * to the bit; guy_step() and the crowd only differ by sinf() */
+	const int sizes[] = {1000, 10000, 100000};
+	const int n_sizes = sizeof sizes / sizeof sizes[0];
+	const int n_frames = 200;
+	const char* kernel =
+	#if defined(__SSE2__)
+		"sse2";
+	#else
+		"scalar";
+	#endif
+	struct pool* pool = pool_create(0);
+	printf("%10s %14s %14s %14s %14s (%d threads, %s)\n", "guys", "guy_step ns", "threaded ns", "scalar ns", "crowd_step ns", pool->n_threads, kernel);
+	for (int si = 0; si < n_sizes; si++) {
+		const int n_guys = sizes[si];
+		const double n_steps = (double)n_guys * (double)n_frames;
+
+		struct guy* guys = xcalloc(n_guys, sizeof *guys);
+		bench_crowd__setup(NULL, guys, n_guys);
+		Uint64 t0 = SDL_GetPerformanceCounter();
+		for (int frame = 0; frame < n_frames; frame++) {
+			for (int i = 0; i < n_guys; i++) guy_step(&guys[i]);
+		}
+		const double dt_guys = seconds_since(t0);
+
+		struct bench_crowd_job job = {.n_guys = n_guys};
+		job.guys = xcalloc(n_guys, sizeof *job.guys);
+		bench_crowd__setup(NULL, job.guys, n_guys);
+		t0 = SDL_GetPerformanceCounter();
+		for (int frame = 0; frame < n_frames; frame++) pool_run(pool, BENCH_CROWD_SLICES, bench_crowd_job, &job);
+		const double dt_threaded = seconds_since(t0);
+		if (memcmp(job.guys, guys, n_guys * sizeof *guys) != 0) {
+			fprintf(stderr, "guy_step() on threads differs from one thread\n");
+			abort();
+		}
 
-	/* body */
-	{
-		nvgBeginPath(vg);
+		struct crowd scalar;
+		crowd_init(&scalar, n_guys, BENCH_CROWD_SEED);
+		bench_crowd__setup(&scalar, NULL, n_guys);
+		t0 = SDL_GetPerformanceCounter();
+		for (int frame = 0; frame < n_frames; frame++) {
+			for (int i = 0; i < n_guys; i++) crowd__step_one(&scalar, i);
+		}
+		const double dt_scalar = seconds_since(t0);
 
-		const float x = 0;
-		const float y = 10;
-		const float x1 = 5;
-		const float y1 = -5;
-		const float x2 = 14;
-		const float y2 = 10;
-		const float x3 = 10;
-		const float y3 = 20;
-
-		nvgMoveTo(vg, x, y);
-		nvgBezierTo(vg, x+x1, y+y1, x+x2, y+y2, x+x3, y+y3);
-		nvgLineTo(vg, -10, 30);
-		nvgBezierTo(vg, x-x2, y+y2, x-x1, y+y1, x, y);
-		nvgClosePath(vg);
-		nvgFillColor(vg, nvgRGBA(0,50,150,255));
-		nvgFill(vg);
-		nvgStrokeColor(vg, nvgRGBA(0,0,0,255));
-		nvgStrokeWidth(vg, 2);
-		nvgStroke(vg);
-	}
-
-	/* head */
-	{
-		nvgSave(vg);
+		struct crowd c;
+		crowd_init(&c, n_guys, BENCH_CROWD_SEED);
+		bench_crowd__setup(&c, NULL, n_guys);
+		t0 = SDL_GetPerformanceCounter();
+		for (int frame = 0; frame < n_frames; frame++) crowd_step(&c);
+		const double dt_crowd = seconds_since(t0);
 
-		const float head_r = 10;
+		if (memcmp(c.arena.base, scalar.arena.base, c.arena.used) != 0) {
+			fprintf(stderr, "crowd_step() differs from crowd__step_one()\n");
+			abort();
+		}
+		for (int i = 0; i < n_guys; i++) {
+			struct guy g;
+			crowd_get_guy(&c, i, &g);
+			const struct guy* ref = &guys[i];
+			if (g.x != ref->x || g.y != ref->y || g.blink_timer != ref->blink_timer || g.eye_left_blink != ref->eye_left_blink
+				|| fabsf(g.head_tilt - ref->head_tilt) > 1e-4f || fabsf(g.head_turn - ref->head_turn) > 1e-4f
+				|| fabsf(g.head_up - ref->head_up) > 1e-4f) {
+				fprintf(stderr, "crowd guy %d differs from guy_step()\n", i);
+				abort();
+			}
+		}
 
-		nvgTranslate(vg, 0, head_r);
-		nvgRotate(vg, guy->head_tilt);
-		nvgTranslate(vg, 0, -head_r);
+		printf("%10d %14.2f %14.2f %14.2f %14.2f\n", n_guys, dt_guys / n_steps * 1e9, dt_threaded / n_steps * 1e9, dt_scalar / n_steps * 1e9, dt_crowd / n_steps * 1e9);
 
-		nvgBeginPath(vg);
-		nvgCircle(vg, 0, 0, head_r);
-		nvgFillColor(vg, nvgRGBA(240,120,100,255));
-		nvgFill(vg);
-		nvgStrokeColor(vg, nvgRGBA(0,0,0,255));
-		nvgStrokeWidth(vg, 2);
-		nvgStroke(vg);
-
-		/* eyes */
-		const float eye_r = guy->eye_r;
-
-		float eye_left_phi = -guy->eye_spacing + guy->head_turn;
-		float eye_right_phi = guy->eye_spacing + guy->head_turn;
-
-		nvgFillColor(vg, nvgRGBA(0,0,0,255));
-		if (eye_left_phi > -NVG_PI/2 && eye_left_phi < NVG_PI/2) {
-			float eyex = sinf(eye_left_phi) * head_r;
-			nvgBeginPath(vg);
-			nvgEllipse(vg, eyex, -guy->head_up, eye_r, eye_r * (1.0f - guy->eye_left_blink));
-			nvgFill(vg);
+		crowd_free(&c);
+		crowd_free(&scalar);
+		free(job.guys);
+		free(guys);
+	}
+	pool_destroy(pool);
+
+	/* crowd_step_start() of the largest crowd for 1 to n_cpus threads;
+	 * must match crowd_step() to the bit */
+	const int n_guys = sizes[n_sizes-1];
+	struct crowd ref;
+	crowd_init(&ref, n_guys, BENCH_CROWD_SEED);
+	bench_crowd__setup(&ref, NULL, n_guys);
+	for (int frame = 0; frame < n_frames; frame++) crowd_step(&ref);
+	int n_cpus = SDL_GetCPUCount();
+	if (n_cpus < 2) n_cpus = 2;
+	printf("%8s %14s\n", "threads", "crowd ms/frame");
+	for (int n_threads = 1; n_threads <= n_cpus; n_threads++) {
+		struct pool* pool = pool_create(n_threads);
+		struct crowd c;
+		crowd_init(&c, n_guys, BENCH_CROWD_SEED);
+		bench_crowd__setup(&c, NULL, n_guys);
+		Uint64 t0 = SDL_GetPerformanceCounter();
+		for (int frame = 0; frame < n_frames; frame++) {
+			crowd_step_start(&c, pool);
+			pool_wait(pool);
 		}
+		const double dt = seconds_since(t0);
+		if (memcmp(c.arena.base, ref.arena.base, c.arena.used) != 0) {
+			fprintf(stderr, "crowd_step_start() differs from crowd_step()\n");
+			abort();
+		}
+		printf("%8d %14.3f\n", n_threads, dt / n_frames * 1e3);
+		crowd_free(&c);
+		pool_destroy(pool);
+	}
+	crowd_free(&ref);
+}
 
-		if (eye_right_phi > -NVG_PI/2 && eye_right_phi < NVG_PI/2) {
-			float eyex = sinf(eye_right_phi) * head_r;
-			nvgBeginPath(vg);
-			nvgEllipse(vg, eyex, -guy->head_up, eye_r, eye_r * (1.0f - guy->eye_right_blink));
-			nvgFill(vg);
+static void bench_grid()
+{
+	/* grid_build() of a crowd's positions and the nearest other guy for
+	 * every guy, against a brute force search over all guys (timed on a
+	 * sample of guys, which must find the same ones, and scaled up), and
+	 * a whole step with each guy looking at its nearest neighbour */
+	const int sizes[] = {10000, 100000};
+	const int n_sizes = sizeof sizes / sizeof sizes[0];
+	const int n_runs = 10;
+	const int n_samples = 500;
+
+	{
+		/* guys walking with nobody in range must hold their heads as
+		 * if they looked nowhere: not back where they came from */
+		const int n_guys = 7;
+		struct crowd alone, looking;
+		crowd_init(&alone, n_guys, BENCH_CROWD_SEED);
+		crowd_init(&looking, n_guys, BENCH_CROWD_SEED);
+		for (int i = 0; i < n_guys; i++) {
+			const float x = i * 10.0f * CROWD_LOOKAT_MAX;
+			crowd_add(&alone, x, 0.0f);
+			crowd_add(&looking, x, 0.0f);
+			crowd_set_target(&alone, i, x + 50.0f, 30.0f);
+			crowd_set_target(&looking, i, x + 50.0f, 30.0f);
+			crowd_lookat_nowhere(&alone, i);
+		}
+		struct grid g;
+		grid_init(&g, n_guys, CROWD_LOOKAT_MAX);
+		crowd_set_lookat_grid(&looking, &g, 1);
+		for (int step = 0; step < 20; step++) {
+			grid_build(&g, looking.x, looking.y, n_guys);
+			crowd_step(&alone);
+			crowd_step(&looking);
+			for (int i = 0; i < n_guys; i++) {
+				if (looking.head_turn[i] != alone.head_turn[i] || looking.head_up[i] != alone.head_up[i] || looking.head_tilt[i] != alone.head_tilt[i]) {
+					fprintf(stderr, "guy %d with nobody in range turned its head on step %d\n", i, step);
+					abort();
+				}
+			}
 		}
+		grid_free(&g);
+		crowd_free(&looking);
+		crowd_free(&alone);
+	}
 
-		nvgRestore(vg);
+	printf("%10s %12s %12s %14s %12s %12s\n", "guys", "build ms", "query ms", "brute ms", "step ms", "neighbours");
+	for (int si = 0; si < n_sizes; si++) {
+		const int n_guys = sizes[si];
+		/* ~20 guys within CROWD_LOOKAT_MAX of each guy */
+		const float side = sqrtf((float)n_guys) * 40.0f;
+		uint32_t rng = rng_seed(BENCH_CROWD_SEED);
+		struct crowd c;
+		crowd_init(&c, n_guys, BENCH_CROWD_SEED);
+		for (int i = 0; i < n_guys; i++) {
+			const float x = (float)rng_next(&rng) * (side / 4294967296.0f);
+			const float y = (float)rng_next(&rng) * (side / 4294967296.0f);
+			crowd_add(&c, x, y);
+			crowd_set_target(&c, i, (float)rng_next(&rng) * (side / 4294967296.0f), (float)rng_next(&rng) * (side / 4294967296.0f));
+		}
+		struct grid g;
+		grid_init(&g, n_guys, CROWD_LOOKAT_MAX);
+
+		Uint64 t0 = SDL_GetPerformanceCounter();
+		for (int run = 0; run < n_runs; run++) grid_build(&g, c.x, c.y, n_guys);
+		const double dt_build = seconds_since(t0) / n_runs;
+
+		int* nearest = xcalloc(n_guys, sizeof *nearest);
+		int n_neighbours = 0;
+		t0 = SDL_GetPerformanceCounter();
+		for (int run = 0; run < n_runs; run++) {
+			n_neighbours = 0;
+			for (int i = 0; i < n_guys; i++) {
+				float x, y;
+				nearest[i] = grid_nearest(&g, c.x[i], c.y[i], CROWD_LOOKAT_MAX, i, &x, &y);
+				n_neighbours += (nearest[i] >= 0);
+			}
+		}
+		const double dt_query = seconds_since(t0) / n_runs;
+
+		t0 = SDL_GetPerformanceCounter();
+		for (int sample = 0; sample < n_samples; sample++) {
+			const int i = (int)((int64_t)sample * n_guys / n_samples);
+			float best_dsqr = CROWD_LOOKAT_MAX*CROWD_LOOKAT_MAX;
+			int best = -1;
+			for (int j = 0; j < n_guys; j++) {
+				if (j == i) continue;
+				const float dx = c.x[j] - c.x[i];
+				const float dy = c.y[j] - c.y[i];
+				const float dsqr = dx*dx + dy*dy;
+				if (dsqr < best_dsqr) {
+					best_dsqr = dsqr;
+					best = j;
+				}
+			}
+			if (best != nearest[i]) {
+				fprintf(stderr, "grid_nearest() found %d for guy %d, brute force %d\n", nearest[i], i, best);
+				abort();
+			}
+		}
+		const double dt_brute = seconds_since(t0) * ((double)n_guys / n_samples);
+
+		crowd_set_lookat_grid(&c, &g, 1);
+		t0 = SDL_GetPerformanceCounter();
+		for (int run = 0; run < n_runs; run++) {
+			grid_build(&g, c.x, c.y, n_guys);
+			crowd_step(&c);
+		}
+		const double dt_step = seconds_since(t0) / n_runs;
+
+		printf("%10d %12.3f %12.3f %14.1f %12.3f %12d\n", n_guys, dt_build*1e3, dt_query*1e3, dt_brute*1e3, dt_step*1e3, n_neighbours);
+
+		free(nearest);
+		grid_free(&g);
+		crowd_free(&c);
+	}
+}
+
+struct bench {
+	const char* name;
+	void (*fn)();
+};
+
+static const struct bench benches[] = {
+	{"math", bench_math},
+	{"prep", bench_prep},
+	{"prep_parallel", bench_prep_parallel},
+	{"facing", bench_facing},
+	{"incremental", bench_incremental},
+	{"extract", bench_extract},
+	{"path", bench_path},
+	{"load", bench_load},
+	{"import", bench_import},
+	{"lod", bench_lod},
+	{"crowd", bench_crowd},
+	{"grid", bench_grid},
+	{NULL, NULL}
+};
+
+/* ./main2 --bench [name...]; runs all benchmarks if no names are given */
+static int bench_main(int argc, char** argv)
+{
+	int n_run = 0;
+	for (const struct bench* b = benches; b->name != NULL; b++) {
+		int run = (argc == 0);
+		for (int i = 0; i < argc; i++) if (strcmp(argv[i], b->name) == 0) run = 1;
+		if (!run) continue;
+		printf("== %s\n", b->name);
+		b->fn();
+		n_run++;
+	}
+	if (n_run == 0) {
+		fprintf(stderr, "no such benchmark; available:");
+		for (const struct bench* b = benches; b->name != NULL; b++) fprintf(stderr, " %s", b->name);
+		fprintf(stderr, "\n");
+		return EXIT_FAILURE;
 	}
+	return EXIT_SUCCESS;
+}
 
+/* ./main2 --convert <source> <path> writes a mesh cache (see outline_save())
+ * with OUTLINE_LOD_LEVELS levels of detail; source is
+ * hat:<segments>x<strips> or an OBJ/PLY file */
+static int convert_main(int argc, char** argv)
+{
+	if (argc != 2) {
+		fprintf(stderr, "usage: main2 --convert <hat:<segments>x<strips> | mesh.obj | mesh.ply> <path>\n");
+		return EXIT_FAILURE;
+	}
+	struct outline o;
+	int n_segments, n_strips;
+	if (sscanf(argv[0], "hat:%dx%d", &n_segments, &n_strips) == 2 && n_segments > 0 && n_strips > 2) {
+		outline_init_hat(&o, n_segments, n_strips);
+	} else {
+		struct stat st;
+		Uint64 t0 = SDL_GetPerformanceCounter();
+		if (outline_import_specified(&o, argv[0]) != 0) return EXIT_FAILURE;
+		const double dt_import = seconds_since(t0);
+		struct pool* pool = pool_create(0);
+		t0 = SDL_GetPerformanceCounter();
+		outline_prep_parallel(&o, pool);
+		const double dt_prep = seconds_since(t0);
+		pool_destroy(pool);
+		const double mb = (stat(argv[0], &st) == 0) ? st.st_size / (1024.0*1024.0) : 0.0;
+		printf("%s: %.1f MB imported in %.3f s (%.1f MB/s), prep %.3f s\n", argv[0], mb, dt_import, mb / dt_import, dt_prep);
+	}
+	outline_prep_lods(&o, OUTLINE_LOD_LEVELS);
+	const int result = outline_save(&o, argv[1]);
+	if (result == 0) {
+		int n_levels = 0;
+		size_t n_bytes = 0;
+		for (const struct outline* level = &o; level != NULL; level = level->lod) {
+			n_levels++;
+			n_bytes += sizeof(struct outline_cache_header) + level->arena.used;
+		}
+		printf("%s: %d polygons, %d levels, %zu bytes\n", argv[1], o.n_polygons, n_levels, n_bytes);
+	}
+	outline_free(&o);
+	return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
-	nvgRestore(vg);
+static void hat_material_draw(NVGcontext* vg, int material, void* usr)
+{
+	nvgFillColor(vg, material == 0 ? nvgRGBA(100,100,100,255) : nvgRGBA(255,0,0,255));
+	nvgFill(vg);
+	nvgStrokeColor(vg, nvgRGBA(0,0,0,255));
+	nvgStrokeWidth(vg, 2);
+	nvgStroke(vg);
 }
 
 int main(int argc, char** argv)
 {
-	assert(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER) == 0);
+	if (argc >= 2 && strcmp(argv[1], "--bench") == 0) {
+		return bench_main(argc-2, argv+2);
+	}
+	if (argc >= 2 && strcmp(argv[1], "--convert") == 0) {
+		return convert_main(argc-2, argv+2);
+	}
+	struct headless headless;
+	const int is_headless = headless_init(&headless, argc, argv);
+	const int is_software = is_headless && headless.software;
+
+	if (SDL_Init(is_software ? SDL_INIT_TIMER : SDL_INIT_VIDEO | SDL_INIT_TIMER) != 0) {
+		fprintf(stderr, "SDL_Init failed: %s\n", SDL_GetError());
+		abort();
+	}
 	atexit(SDL_Quit);
 
-	SDL_GLContext glctx;
-	{
+	struct pool* pool = pool_create(0);
+
+	SDL_GLContext glctx = NULL;
+	if (!is_software) {
 		#ifdef BUILD_LINUX
 		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
 		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 0);
@@ -779,8 +5104,8 @@ int main(int argc, char** argv)
 		window = SDL_CreateWindow(
 				"SDL2/NanoVG/GLES3",
 				SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-				1920, 1080,
-				SDL_WINDOW_RESIZABLE | SDL_WINDOW_OPENGL | SDL_WINDOW_ALLOW_HIGHDPI);
+				is_headless ? headless.width : 1920, is_headless ? headless.height : 1080,
+				is_headless ? (SDL_WINDOW_HIDDEN | SDL_WINDOW_OPENGL) : (SDL_WINDOW_RESIZABLE | SDL_WINDOW_OPENGL | SDL_WINDOW_ALLOW_HIGHDPI));
 		if (window == NULL) {
 			fprintf(stderr, "SDL_CreateWindow failed: %s\n", SDL_GetError());
 			abort();
@@ -792,24 +5117,60 @@ int main(int argc, char** argv)
 		}
 	}
 
-	NVGcontext* vg = nanovg_create_context();
-	assert(vg != NULL);
+	NVGcontext* vg;
+	if (is_software) {
+		const struct nanovg_sw_parallel parallel = {
+			.run = pool_run_nanovg_sw,
+			.usr = pool,
+			.n_threads = pool->n_threads,
+		};
+		vg = nanovg_sw_create(&parallel);
+	} else {
+		vg = nanovg_create_context();
+	}
+	if (vg == NULL) {
+		fprintf(stderr, "nanovg_create_context failed\n");
+		abort();
+	}
 
-	int font = nvgCreateFont(vg, "sans", "./nanovg/example/Roboto-Regular.ttf");
-	assert(font != -1);
+	if (nvgCreateFont(vg, "sans", "./nanovg/example/Roboto-Regular.ttf") == -1) {
+		fprintf(stderr, "nvgCreateFont failed\n");
+		abort();
+	}
 
 	nvgFontFace(vg, "sans");
 
 	int screen_width = 0;
 	int screen_height = 0;
 	float pixel_ratio = 0.0f;
-	window_size(&screen_width, &screen_height, &pixel_ratio);
+	NVGLUframebuffer* framebuffer = NULL;
+	unsigned char* software_framebuffer = NULL;
+	if (is_software) {
+		software_framebuffer = xcalloc((size_t)headless.width * headless.height, 4);
+		nanovg_sw_set_framebuffer(vg, software_framebuffer, headless.width, headless.height, headless.width*4);
+		screen_width = headless.width;
+		screen_height = headless.height;
+		pixel_ratio = 1.0f;
+	} else if (is_headless) {
+		framebuffer = nvgluCreateFramebuffer(vg, headless.width, headless.height, 0);
+		if (framebuffer == NULL) {
+			fprintf(stderr, "nvgluCreateFramebuffer failed\n");
+			abort();
+		}
+		screen_width = headless.width;
+		screen_height = headless.height;
+		pixel_ratio = 1.0f;
+	} else {
+		window_size(&screen_width, &screen_height, &pixel_ratio);
+	}
 
 	int swap_interval = 1;
-	SDL_GL_SetSwapInterval(1);
+	if (!is_software) SDL_GL_SetSwapInterval(1);
 
-	struct guy guy;
-	guy_init(&guy);
+	/* the mouse steers guy 0 */
+	struct crowd crowd;
+	crowd_init(&crowd, 1, 1);
+	crowd_add(&crowd, 100, 100);
 
 	int exiting = 0;
 	float fps = 0.0f;
@@ -818,11 +5179,30 @@ int main(int argc, char** argv)
 	Uint32 last_ticks = 0;
 
 
-	struct outline outline;
-	outline_init_hat(&outline);
-
-	float x = 0.0f;
+	/* hat.outline is written by make hat.outline (see convert_main()) with
+	 * its levels of detail; build it all from scratch if it is missing or
+	 * stale */
+	struct outline* outline = outline_create_load("hat.outline");
+	if (outline == NULL) {
+		outline = outline_create_hat(12, 32);
+		outline_prep_lods(outline, OUTLINE_LOD_LEVELS);
+	}
+	struct outline_scratch outline_scratch;
+	outline_scratch_init(&outline_scratch, outline);
+	outline_set_incremental(&outline_scratch, 1);
+	struct outline_contours outline_contours = {0};
+
+	/* the simulation runs at SIM_HZ whatever the frame rate, and frames
+	 * draw between its last two steps. Headless frames are 1/SIM_HZ apart,
+	 * so every run draws the same frames */
+	const Uint64 sim_step_ticks = SDL_GetPerformanceFrequency() / SIM_HZ;
+	const Uint64 sim_start = SDL_GetPerformanceCounter();
+	Uint64 sim_time = sim_start;
+	float hat_angle = 0.0f;
+	float prev_hat_angle = 0.0f;
 	while (!exiting) {
+		if (is_headless) headless_frame_begin(&headless);
+
 		SDL_Event e;
 		while (SDL_PollEvent(&e)) {
 			if (e.type == SDL_QUIT) {
@@ -839,9 +5219,9 @@ int main(int argc, char** argv)
 					SDL_SetWindowFullscreen(window, fullscreen ? SDL_WINDOW_FULLSCREEN_DESKTOP : 0);
 				}
 			} else if (e.type == SDL_MOUSEBUTTONDOWN) {
-				guy_set_target(&guy, e.button.x, e.button.y);
+				crowd_set_target(&crowd, 0, e.button.x, e.button.y);
 			} else if (e.type == SDL_MOUSEMOTION) {
-				guy_lookat(&guy, e.motion.x, e.motion.y);
+				crowd_lookat(&crowd, 0, e.motion.x, e.motion.y);
 			} else if (e.type == SDL_WINDOWEVENT) {
 				if (e.window.event == SDL_WINDOWEVENT_RESIZED) {
 					window_size(&screen_width, &screen_height, &pixel_ratio);
@@ -849,24 +5229,49 @@ int main(int argc, char** argv)
 			}
 		}
 
-		glViewport(0, 0, screen_width, screen_height);
-		glClearColor(0, 0.2, 0.1, 0);
-		glClear(GL_COLOR_BUFFER_BIT);
+		const Uint64 now = is_headless ? sim_start + (Uint64)headless.frame * sim_step_ticks : SDL_GetPerformanceCounter();
+		int n_steps = 0;
+		while (now - sim_time >= sim_step_ticks) {
+			sim_time += sim_step_ticks;
+			n_steps++;
+		}
+		if (n_steps > SIM_MAX_STEPS_PER_FRAME) n_steps = SIM_MAX_STEPS_PER_FRAME;
+		const float sim_t = (float)(now - sim_time) / (float)sim_step_ticks;
+
+		/* the crowd's last step runs on the pool while this thread sets
+		 * up GL (nanovg_sw.c only draws at nvgEndFrame()) */
+		for (int step = 0; step < n_steps; step++) {
+			if (step > 0) pool_wait(pool);
+			crowd_step_start(&crowd, pool);
+			prev_hat_angle = hat_angle;
+			hat_angle += 0.01f;
+		}
+		const float hat_phi = lerpf(prev_hat_angle, hat_angle, sim_t);
+
+		if (is_software) {
+			nanovg_sw_clear(vg, nvgRGBAf(0, 0.2f, 0.1f, 0));
+		} else {
+			if (framebuffer != NULL) nvgluBindFramebuffer(framebuffer);
+			glViewport(0, 0, screen_width, screen_height);
+			glClearColor(0, 0.2, 0.1, 0);
+			glClear(GL_COLOR_BUFFER_BIT);
+
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			glEnable(GL_CULL_FACE);
+			glDisable(GL_DEPTH_TEST);
+		}
 
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-		glEnable(GL_CULL_FACE);
-		glDisable(GL_DEPTH_TEST);
+		pool_wait(pool);
 
 		nvgBeginFrame(vg, screen_width / pixel_ratio, screen_height / pixel_ratio, pixel_ratio);
 
-		guy_step(&guy);
-		guy_draw(&guy, vg);
+		crowd_draw(&crowd, vg, sim_t);
 
 		{
 			nvgSave(vg);
 			nvgTranslate(vg, 150, 150);
-			nvgRotate(vg, x);
+			nvgRotate(vg, hat_phi);
 			nvgTranslate(vg, -150, -150);
 			nvgBeginPath(vg);
 			nvgMoveTo(vg, 100, 100);
@@ -886,33 +5291,12 @@ int main(int argc, char** argv)
 
 		{
 			union m33 tx;
-			m33_set_rotate(&tx, x, v3_axis_x());
+			m33_set_rotate(&tx, hat_phi, v3_axis_x());
 			nvgSave(vg);
 			nvgTranslate(vg, 1000, 150);
 
-			XXX_TODO_RESOLVE_MULTIPLE_EXITS = 0;
-			if (outline_draw(&outline, vg, &tx, 0)) {
-				nvgFillColor(vg, nvgRGBA(100,100,100,255));
-				nvgFill(vg);
-				nvgStrokeColor(vg, nvgRGBA(0,0,0,255));
-				nvgStrokeWidth(vg, 2);
-				nvgStroke(vg);
-			}
-
-			if (outline_draw(&outline, vg, &tx, 1)) {
-				nvgFillColor(vg, nvgRGBA(255,0,0,255));
-				nvgFill(vg);
-				nvgStrokeColor(vg, nvgRGBA(0,0,0,255));
-				nvgStrokeWidth(vg, 2);
-				nvgStroke(vg);
-			}
-
-			if (XXX_TODO_RESOLVE_MULTIPLE_EXITS) {
-				nvgBeginPath(vg);
-				nvgRect(vg,200,200,50,50);
-				nvgFillColor(vg, nvgRGBA(255,0,0,255));
-				nvgFill(vg);
-			}
+			outline_extract(outline, &outline_scratch, &tx, &outline_contours);
+			outline_emit(&outline_contours, vg, hat_material_draw, NULL);
 
 			nvgRestore(vg);
 		}
@@ -934,7 +5318,11 @@ int main(int argc, char** argv)
 
 		nvgEndFrame(vg);
 
-		SDL_GL_SwapWindow(window);
+		if (is_headless) {
+			if (headless_frame_end(&headless)) exiting = 1;
+		} else {
+			SDL_GL_SwapWindow(window);
+		}
 
 		fps_counter++;
 		Uint32 ticks = SDL_GetTicks();
@@ -943,12 +5331,28 @@ int main(int argc, char** argv)
 			last_ticks = ticks;
 			fps_counter = 0;
 		}
+	}
 
-		x += 0.01f;
+	outline_contours_free(&outline_contours);
+	outline_scratch_free(&outline_scratch);
+	outline_release(outline);
+	crowd_free(&crowd);
+	pool_destroy(pool);
+
+	if (is_headless) {
+		if (is_software) headless_save_frame(&headless, software_framebuffer, headless.width*4);
+		headless_report(&headless, "main2");
+		headless_free(&headless);
+		nvgluDeleteFramebuffer(framebuffer);
 	}
 
-	SDL_GL_DeleteContext(glctx);
-	SDL_DestroyWindow(window);
+	if (is_software) {
+		nanovg_sw_delete(vg);
+		free(software_framebuffer);
+	} else {
+		SDL_GL_DeleteContext(glctx);
+		SDL_DestroyWindow(window);
+	}
 
 	return EXIT_SUCCESS;
 }
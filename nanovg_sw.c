@@ -0,0 +1,1181 @@
+/* nanovg backend that draws on the CPU into premultiplied RGBA8 (see
+ * nanovg_sw.h); nanovg_gl.c's counterpart for runs without a GPU.
+ *
+ * The render* callbacks only record calls, and renderFlush() (from
+ * nvgEndFrame()) draws them. The framebuffer is cut into bands of
+ * NANOVG_SW_BAND_HEIGHT rows, one job each: a counting sort by band hands
+ * every band the primitives (edges, or triangles) that touch it, in call
+ * order, and the band's job draws its calls one after the other into a
+ * float copy of its pixels, which it writes back at the end. Bands share
+ * no pixels, so the jobs need no locks, and the image doesn't depend on
+ * the number of threads.
+ *
+ * Fills and strokes get analytic coverage instead of nanovg's fringes
+ * (edgeAntiAlias is off, so nanovg hands over bare polygons): every edge
+ * adds the signed area it covers to an accumulation buffer, as in font-rs,
+ * and a prefix sum along each row turns that into coverage, min(1, |sum|),
+ * which is the nonzero rule. Stroke strips are split into triangles of one
+ * orientation, so overlaps saturate instead of cancelling. Text quads
+ * (renderTriangles()) sample pixel centers like the GPU does, since their
+ * antialiasing is in the glyph atlas. Paints, scissors and composite
+ * operations follow nanovg_gl.h's shader and blend state */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "nanovg.h"
+#include "nanovg_sw.h"
+
+#define NANOVG_SW_BAND_HEIGHT (16)
+
+/* less coverage than this can't change an 8-bit channel */
+#define NANOVG_SW_MIN_COVERAGE (1.0f / 1024.0f)
+
+/* triangle vertices snap to 1/256 pixel, so two triangles agree exactly on
+ * which pixel centers on their shared edge belong to which */
+#define NANOVG_SW_SUBPIXEL_BITS (8)
+#define NANOVG_SW_MAX_COORDINATE (1 << 20)
+
+enum {
+	NANOVG_SW_CLEAR,
+	NANOVG_SW_FILL,
+	NANOVG_SW_STROKE,
+	NANOVG_SW_TRIANGLES
+};
+
+struct nanovg_sw_texture {
+	int id;
+	int type; // NVG_TEXTURE_*
+	int width;
+	int height;
+	int flags; // NVG_IMAGE_*
+	unsigned char* data;
+};
+
+/* glnvg__convertPaint()'s uniforms */
+struct nanovg_sw_paint {
+	int solid; // one color everywhere, and no scissor
+	float inner[4]; // premultiplied
+	float outer[4];
+	float mat[6]; // nanovg units -> paint space
+	float extent[2];
+	float radius;
+	float feather;
+	int image;
+	int tex_type; // 0: premultiplied RGBA, 1: straight RGBA, 2: alpha
+	const struct nanovg_sw_texture* tex; // image's, looked up at flush
+
+	int has_scissor;
+	float scissor_mat[6];
+	float scissor_ext[2];
+	float scissor_scale[2];
+};
+
+struct nanovg_sw_call {
+	int type;
+	struct nanovg_sw_paint paint;
+	NVGcompositeOperationState op;
+	int source_over;
+	float clear_color[4];
+
+	// edges for fills and strokes, triangles for triangles, one for clears
+	int first;
+	int count;
+	int prim_first; // numbered across all calls, for binning
+
+	// pixels it can touch: [x0;x1) × [y0;y1)
+	int x0, y0;
+	int x1, y1;
+};
+
+/* device pixels, clipped to x in [0;width] */
+struct nanovg_sw_edge {
+	float x0, y0;
+	float x1, y1;
+};
+
+struct nanovg_sw_tri {
+	float x[3], y[3];
+	float u[3], v[3];
+};
+
+struct nanovg_sw_scratch {
+	float* acc; // NANOVG_SW_BAND_HEIGHT rows of width+2
+	float* color; // NANOVG_SW_BAND_HEIGHT rows of width RGBA pixels
+};
+
+struct nanovg_sw {
+	struct nanovg_sw_parallel parallel;
+
+	unsigned char* framebuffer;
+	int width;
+	int height;
+	int stride;
+	float scale; // device pixels per nanovg unit
+
+	struct nanovg_sw_texture* textures;
+	int n_textures;
+	int textures_cap;
+	int last_texture_id;
+
+	// the frame so far
+	struct nanovg_sw_call* calls;
+	int n_calls;
+	int calls_cap;
+	struct nanovg_sw_edge* edges;
+	int n_edges;
+	int edges_cap;
+	struct nanovg_sw_tri* tris;
+	int n_tris;
+	int tris_cap;
+	int n_prims;
+
+	// per band: refs[band_offsets[b];band_offsets[b+1]) are primitive
+	// numbers, and [band_x0[b];band_x1[b]) the columns they touch
+	int* band_offsets;
+	int* band_cursors;
+	int* band_x0;
+	int* band_x1;
+	int bands_cap;
+	int* refs;
+	int refs_cap;
+
+	struct nanovg_sw_scratch* scratch; // one per thread
+	int scratch_width;
+};
+
+static void* xcalloc(size_t n, size_t size)
+{
+	void* p = calloc(n, size);
+	if (p == NULL && n > 0 && size > 0) {
+		fprintf(stderr, "out of memory (%zu×%zu bytes)\n", n, size);
+		abort();
+	}
+	return p;
+}
+
+static void* xrealloc(void* p, size_t size)
+{
+	p = realloc(p, size);
+	if (p == NULL && size > 0) {
+		fprintf(stderr, "out of memory (%zu bytes)\n", size);
+		abort();
+	}
+	return p;
+}
+
+/* makes room for n elements of size in *p */
+static void nanovg_sw__reserve(void** p, int* cap, int n, size_t size)
+{
+	if (n <= *cap) return;
+	int new_cap = *cap > 0 ? *cap : 64;
+	while (new_cap < n) new_cap *= 2;
+	*p = xrealloc(*p, (size_t)new_cap * size);
+	*cap = new_cap;
+}
+
+static inline int nanovg_sw__mini(int a, int b) { return a < b ? a : b; }
+static inline int nanovg_sw__maxi(int a, int b) { return a > b ? a : b; }
+
+static inline float nanovg_sw__clampf(float x, float lo, float hi)
+{
+	return x < lo ? lo : x > hi ? hi : x;
+}
+
+static struct nanovg_sw* nanovg_sw__get(NVGcontext* vg)
+{
+	return nvgInternalParams(vg)->userPtr;
+}
+
+
+// textures
+
+static struct nanovg_sw_texture* nanovg_sw__texture(struct nanovg_sw* sw, int id)
+{
+	for (int i = 0; i < sw->n_textures; i++) {
+		if (sw->textures[i].id == id) return &sw->textures[i];
+	}
+	return NULL;
+}
+
+static int nanovg_sw__bytes_per_pixel(int type)
+{
+	return type == NVG_TEXTURE_RGBA ? 4 : 1;
+}
+
+static int nanovg_sw__render_create_texture(void* uptr, int type, int w, int h, int image_flags, const unsigned char* data)
+{
+	struct nanovg_sw* sw = uptr;
+	nanovg_sw__reserve((void**)&sw->textures, &sw->textures_cap, sw->n_textures+1, sizeof *sw->textures);
+	struct nanovg_sw_texture* tex = &sw->textures[sw->n_textures++];
+	tex->id = ++sw->last_texture_id;
+	tex->type = type;
+	tex->width = w;
+	tex->height = h;
+	tex->flags = image_flags;
+	const size_t size = (size_t)w * h * nanovg_sw__bytes_per_pixel(type);
+	tex->data = xcalloc(size, 1);
+	if (data != NULL) memcpy(tex->data, data, size);
+	return tex->id;
+}
+
+static int nanovg_sw__render_delete_texture(void* uptr, int image)
+{
+	struct nanovg_sw* sw = uptr;
+	struct nanovg_sw_texture* tex = nanovg_sw__texture(sw, image);
+	if (tex == NULL) return 0;
+	free(tex->data);
+	*tex = sw->textures[--sw->n_textures];
+	return 1;
+}
+
+/* data is the whole image, as for glTexSubImage2D() with
+ * GL_UNPACK_ROW_LENGTH set to the texture's width */
+static int nanovg_sw__render_update_texture(void* uptr, int image, int x, int y, int w, int h, const unsigned char* data)
+{
+	struct nanovg_sw* sw = uptr;
+	struct nanovg_sw_texture* tex = nanovg_sw__texture(sw, image);
+	if (tex == NULL) return 0;
+	const int bpp = nanovg_sw__bytes_per_pixel(tex->type);
+	for (int row = y; row < y+h; row++) {
+		const size_t offset = ((size_t)row * tex->width + x) * bpp;
+		memcpy(tex->data + offset, data + offset, (size_t)w * bpp);
+	}
+	return 1;
+}
+
+static int nanovg_sw__render_get_texture_size(void* uptr, int image, int* w, int* h)
+{
+	struct nanovg_sw* sw = uptr;
+	struct nanovg_sw_texture* tex = nanovg_sw__texture(sw, image);
+	if (tex == NULL) return 0;
+	*w = tex->width;
+	*h = tex->height;
+	return 1;
+}
+
+static void nanovg_sw__texel(const struct nanovg_sw_texture* tex, int x, int y, float* out)
+{
+	if (tex->type == NVG_TEXTURE_RGBA) {
+		const unsigned char* p = tex->data + ((size_t)y * tex->width + x) * 4;
+		for (int i = 0; i < 4; i++) out[i] = p[i] * (1.0f / 255.0f);
+	} else {
+		const float a = tex->data[(size_t)y * tex->width + x] * (1.0f / 255.0f);
+		for (int i = 0; i < 4; i++) out[i] = a;
+	}
+}
+
+/* texel index x (already floored) for GL_REPEAT or GL_CLAMP_TO_EDGE */
+static int nanovg_sw__wrap(float x, int n, int repeat)
+{
+	if (repeat) {
+		x -= floorf(x / n) * n;
+		const int i = (int)x;
+		return i < n ? i : i - n;
+	}
+	return (int)nanovg_sw__clampf(x, 0.0f, (float)(n-1));
+}
+
+/* texture(tex, vec2(u, v)) with the texture's filter and wrap modes */
+static void nanovg_sw__sample(const struct nanovg_sw_texture* tex, float u, float v, float* out)
+{
+	const int repeat_x = (tex->flags & NVG_IMAGE_REPEATX) != 0;
+	const int repeat_y = (tex->flags & NVG_IMAGE_REPEATY) != 0;
+	const float fx = u * tex->width;
+	const float fy = v * tex->height;
+	if (tex->flags & NVG_IMAGE_NEAREST) {
+		const int x = nanovg_sw__wrap(floorf(fx), tex->width, repeat_x);
+		const int y = nanovg_sw__wrap(floorf(fy), tex->height, repeat_y);
+		nanovg_sw__texel(tex, x, y, out);
+		return;
+	}
+	const float x0 = floorf(fx - 0.5f);
+	const float y0 = floorf(fy - 0.5f);
+	const float ax = fx - 0.5f - x0;
+	const float ay = fy - 0.5f - y0;
+	const int xs[2] = { nanovg_sw__wrap(x0, tex->width, repeat_x), nanovg_sw__wrap(x0 + 1.0f, tex->width, repeat_x) };
+	const int ys[2] = { nanovg_sw__wrap(y0, tex->height, repeat_y), nanovg_sw__wrap(y0 + 1.0f, tex->height, repeat_y) };
+	float t[4][4];
+	nanovg_sw__texel(tex, xs[0], ys[0], t[0]);
+	nanovg_sw__texel(tex, xs[1], ys[0], t[1]);
+	nanovg_sw__texel(tex, xs[0], ys[1], t[2]);
+	nanovg_sw__texel(tex, xs[1], ys[1], t[3]);
+	for (int i = 0; i < 4; i++) {
+		const float top = t[0][i] + (t[1][i] - t[0][i]) * ax;
+		const float bottom = t[2][i] + (t[3][i] - t[2][i]) * ax;
+		out[i] = top + (bottom - top) * ay;
+	}
+}
+
+
+// paints
+
+static void nanovg_sw__premultiply(float* out, NVGcolor c)
+{
+	out[0] = c.r * c.a;
+	out[1] = c.g * c.a;
+	out[2] = c.b * c.a;
+	out[3] = c.a;
+}
+
+static void nanovg_sw__convert_paint(struct nanovg_sw* sw, struct nanovg_sw_paint* p, const NVGpaint* paint, const NVGscissor* scissor, float fringe)
+{
+	memset(p, 0, sizeof *p);
+	nanovg_sw__premultiply(p->inner, paint->innerColor);
+	nanovg_sw__premultiply(p->outer, paint->outerColor);
+
+	if (scissor->extent[0] >= -0.5f && scissor->extent[1] >= -0.5f) {
+		const float* m = scissor->xform;
+		p->has_scissor = 1;
+		nvgTransformInverse(p->scissor_mat, m);
+		p->scissor_ext[0] = scissor->extent[0];
+		p->scissor_ext[1] = scissor->extent[1];
+		p->scissor_scale[0] = sqrtf(m[0]*m[0] + m[2]*m[2]) / fringe;
+		p->scissor_scale[1] = sqrtf(m[1]*m[1] + m[3]*m[3]) / fringe;
+	}
+
+	nvgTransformInverse(p->mat, paint->xform);
+	p->extent[0] = paint->extent[0];
+	p->extent[1] = paint->extent[1];
+	p->radius = paint->radius;
+	p->feather = paint->feather;
+	p->image = paint->image;
+	if (p->image != 0) {
+		const struct nanovg_sw_texture* tex = nanovg_sw__texture(sw, p->image);
+		if (tex != NULL && tex->type == NVG_TEXTURE_RGBA) {
+			p->tex_type = (tex->flags & NVG_IMAGE_PREMULTIPLIED) ? 0 : 1;
+		} else {
+			p->tex_type = 2;
+		}
+	}
+
+	p->solid = p->image == 0 && !p->has_scissor && memcmp(p->inner, p->outer, sizeof p->inner) == 0;
+}
+
+static float nanovg_sw__scissor_mask(const struct nanovg_sw_paint* p, float x, float y)
+{
+	const float* m = p->scissor_mat;
+	const float sx = fabsf(m[0]*x + m[2]*y + m[4]) - p->scissor_ext[0];
+	const float sy = fabsf(m[1]*x + m[3]*y + m[5]) - p->scissor_ext[1];
+	return nanovg_sw__clampf(0.5f - sx * p->scissor_scale[0], 0.0f, 1.0f)
+		* nanovg_sw__clampf(0.5f - sy * p->scissor_scale[1], 0.0f, 1.0f);
+}
+
+static float nanovg_sw__sdroundrect(float x, float y, float ext_x, float ext_y, float r)
+{
+	const float dx = fabsf(x) - (ext_x - r);
+	const float dy = fabsf(y) - (ext_y - r);
+	const float ox = fmaxf(dx, 0.0f);
+	const float oy = fmaxf(dy, 0.0f);
+	return fminf(fmaxf(dx, dy), 0.0f) + sqrtf(ox*ox + oy*oy) - r;
+}
+
+/* the image at texture coordinates (u, v), times the inner color; a
+ * missing texture is transparent */
+static void nanovg_sw__image_color(const struct nanovg_sw_paint* p, float u, float v, float* out)
+{
+	if (p->tex == NULL) {
+		for (int i = 0; i < 4; i++) out[i] = 0.0f;
+		return;
+	}
+	nanovg_sw__sample(p->tex, u, v, out);
+	if (p->tex_type == 1) {
+		for (int i = 0; i < 3; i++) out[i] *= out[3];
+	}
+	for (int i = 0; i < 4; i++) out[i] *= p->inner[i];
+}
+
+/* the fill paint's premultiplied color at (x, y), in nanovg units */
+static void nanovg_sw__paint_color(const struct nanovg_sw_paint* p, float x, float y, float* out)
+{
+	const float* m = p->mat;
+	const float px = m[0]*x + m[2]*y + m[4];
+	const float py = m[1]*x + m[3]*y + m[5];
+	if (p->image != 0) {
+		float v = py / p->extent[1];
+		if (p->tex != NULL && (p->tex->flags & NVG_IMAGE_FLIPY)) v = 1.0f - v;
+		nanovg_sw__image_color(p, px / p->extent[0], v, out);
+	} else {
+		const float d = nanovg_sw__clampf((nanovg_sw__sdroundrect(px, py, p->extent[0], p->extent[1], p->radius) + p->feather*0.5f) / p->feather, 0.0f, 1.0f);
+		for (int i = 0; i < 4; i++) out[i] = p->inner[i] + (p->outer[i] - p->inner[i]) * d;
+	}
+	if (p->has_scissor) {
+		const float mask = nanovg_sw__scissor_mask(p, x, y);
+		for (int i = 0; i < 4; i++) out[i] *= mask;
+	}
+}
+
+
+// blending
+
+static float nanovg_sw__blend_factor(int factor, const float* src, const float* dst, int i)
+{
+	switch (factor) {
+	case NVG_ZERO: return 0.0f;
+	case NVG_ONE: return 1.0f;
+	case NVG_SRC_COLOR: return src[i];
+	case NVG_ONE_MINUS_SRC_COLOR: return 1.0f - src[i];
+	case NVG_DST_COLOR: return dst[i];
+	case NVG_ONE_MINUS_DST_COLOR: return 1.0f - dst[i];
+	case NVG_SRC_ALPHA: return src[3];
+	case NVG_ONE_MINUS_SRC_ALPHA: return 1.0f - src[3];
+	case NVG_DST_ALPHA: return dst[3];
+	case NVG_ONE_MINUS_DST_ALPHA: return 1.0f - dst[3];
+	case NVG_SRC_ALPHA_SATURATE: return i < 3 ? fminf(src[3], 1.0f - dst[3]) : 1.0f;
+	}
+	return 0.0f;
+}
+
+/* glBlendFuncSeparate() with the call's composite operation, for a
+ * premultiplied src that already has coverage applied */
+static void nanovg_sw__blend(const struct nanovg_sw_call* c, float* dst, const float* src)
+{
+	if (c->source_over) {
+		const float k = 1.0f - src[3];
+		for (int i = 0; i < 4; i++) dst[i] = src[i] + dst[i]*k;
+		return;
+	}
+	float out[4];
+	for (int i = 0; i < 4; i++) {
+		const int rgb = i < 3;
+		const float s = nanovg_sw__blend_factor(rgb ? c->op.srcRGB : c->op.srcAlpha, src, dst, i);
+		const float d = nanovg_sw__blend_factor(rgb ? c->op.dstRGB : c->op.dstAlpha, src, dst, i);
+		out[i] = nanovg_sw__clampf(src[i]*s + dst[i]*d, 0.0f, 1.0f);
+	}
+	memcpy(dst, out, sizeof out);
+}
+
+/* blends the call's paint over pixels [x0;x1) of row y, with coverage cov */
+static void nanovg_sw__blend_row(const struct nanovg_sw* sw, const struct nanovg_sw_call* c, float* color, const float* cov, int x0, int x1, int y)
+{
+	if (c->paint.solid && c->source_over) {
+		const float* src = c->paint.inner;
+		#if defined(__SSE2__)
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 src4 = _mm_loadu_ps(src);
+		const __m128 src_alpha = _mm_set1_ps(src[3]);
+		for (int x = x0; x < x1; x++) {
+			if (cov[x] < NANOVG_SW_MIN_COVERAGE) continue;
+			const __m128 a = _mm_set1_ps(cov[x]);
+			float* p = color + x*4;
+			const __m128 dst = _mm_loadu_ps(p);
+			_mm_storeu_ps(p, _mm_add_ps(_mm_mul_ps(src4, a), _mm_mul_ps(dst, _mm_sub_ps(one, _mm_mul_ps(src_alpha, a)))));
+		}
+		#else
+		for (int x = x0; x < x1; x++) {
+			if (cov[x] < NANOVG_SW_MIN_COVERAGE) continue;
+			const float a = cov[x];
+			const float k = 1.0f - src[3]*a;
+			float* p = color + x*4;
+			for (int i = 0; i < 4; i++) p[i] = src[i]*a + p[i]*k;
+		}
+		#endif
+		return;
+	}
+
+	const float inv_scale = 1.0f / sw->scale;
+	const float py = (y + 0.5f) * inv_scale;
+	for (int x = x0; x < x1; x++) {
+		if (cov[x] < NANOVG_SW_MIN_COVERAGE) continue;
+		float src[4];
+		nanovg_sw__paint_color(&c->paint, (x + 0.5f) * inv_scale, py, src);
+		for (int i = 0; i < 4; i++) src[i] *= cov[x];
+		nanovg_sw__blend(c, color + x*4, src);
+	}
+}
+
+
+// recording
+
+static struct nanovg_sw_call* nanovg_sw__begin_call(struct nanovg_sw* sw, int type)
+{
+	nanovg_sw__reserve((void**)&sw->calls, &sw->calls_cap, sw->n_calls+1, sizeof *sw->calls);
+	struct nanovg_sw_call* c = &sw->calls[sw->n_calls++];
+	memset(c, 0, sizeof *c);
+	c->type = type;
+	c->first = type == NANOVG_SW_TRIANGLES ? sw->n_tris : sw->n_edges;
+	return c;
+}
+
+static void nanovg_sw__begin_paint_call(struct nanovg_sw* sw, struct nanovg_sw_call* c, NVGpaint* paint, NVGcompositeOperationState op, NVGscissor* scissor, float fringe)
+{
+	nanovg_sw__convert_paint(sw, &c->paint, paint, scissor, fringe);
+	c->op = op;
+	c->source_over =
+		op.srcRGB == NVG_ONE && op.dstRGB == NVG_ONE_MINUS_SRC_ALPHA &&
+		op.srcAlpha == NVG_ONE && op.dstAlpha == NVG_ONE_MINUS_SRC_ALPHA;
+}
+
+/* sets the call's primitives and bounds, or drops it if it has none */
+static void nanovg_sw__end_call(struct nanovg_sw* sw, struct nanovg_sw_call* c)
+{
+	float min_x = INFINITY, min_y = INFINITY;
+	float max_x = -INFINITY, max_y = -INFINITY;
+	if (c->type == NANOVG_SW_TRIANGLES) {
+		c->count = sw->n_tris - c->first;
+		for (int i = c->first; i < sw->n_tris; i++) {
+			const struct nanovg_sw_tri* t = &sw->tris[i];
+			for (int k = 0; k < 3; k++) {
+				min_x = fminf(min_x, t->x[k]);
+				max_x = fmaxf(max_x, t->x[k]);
+				min_y = fminf(min_y, t->y[k]);
+				max_y = fmaxf(max_y, t->y[k]);
+			}
+		}
+	} else {
+		c->count = sw->n_edges - c->first;
+		for (int i = c->first; i < sw->n_edges; i++) {
+			const struct nanovg_sw_edge* e = &sw->edges[i];
+			min_x = fminf(min_x, fminf(e->x0, e->x1));
+			max_x = fmaxf(max_x, fmaxf(e->x0, e->x1));
+			min_y = fminf(min_y, fminf(e->y0, e->y1));
+			max_y = fmaxf(max_y, fmaxf(e->y0, e->y1));
+		}
+	}
+	const float w = (float)sw->width;
+	const float h = (float)sw->height;
+	c->x0 = (int)floorf(nanovg_sw__clampf(min_x, 0.0f, w));
+	c->x1 = (int)ceilf(nanovg_sw__clampf(max_x, 0.0f, w));
+	c->y0 = (int)floorf(nanovg_sw__clampf(min_y, 0.0f, h));
+	c->y1 = (int)ceilf(nanovg_sw__clampf(max_y, 0.0f, h));
+	if (c->count == 0 || c->x0 >= c->x1 || c->y0 >= c->y1) {
+		if (c->type == NANOVG_SW_TRIANGLES) sw->n_tris = c->first; else sw->n_edges = c->first;
+		sw->n_calls--;
+		return;
+	}
+	c->prim_first = sw->n_prims;
+	sw->n_prims += c->count;
+}
+
+static void nanovg_sw__push_edge(struct nanovg_sw* sw, float x0, float y0, float x1, float y1)
+{
+	if (y0 == y1) return;
+	nanovg_sw__reserve((void**)&sw->edges, &sw->edges_cap, sw->n_edges+1, sizeof *sw->edges);
+	struct nanovg_sw_edge* e = &sw->edges[sw->n_edges++];
+	e->x0 = x0;
+	e->y0 = y0;
+	e->x1 = x1;
+	e->y1 = y1;
+}
+
+/* adds the edge from (x0, y0) to (x1, y1), in device pixels. What's left
+ * of the framebuffer still counts for the winding of the pixels to its
+ * right, so it moves onto x=0; what's right of it moves onto x=width,
+ * where it only keeps the call's bounds right */
+static void nanovg_sw__edge(struct nanovg_sw* sw, float x0, float y0, float x1, float y1)
+{
+	const float w = (float)sw->width;
+	if (y0 == y1) return;
+	if (fmaxf(y0, y1) <= 0.0f || fminf(y0, y1) >= (float)sw->height) return;
+
+	float ts[4];
+	int n = 0;
+	ts[n++] = 0.0f;
+	if ((x0 < 0.0f) != (x1 < 0.0f)) ts[n++] = (0.0f - x0) / (x1 - x0);
+	if ((x0 < w) != (x1 < w)) ts[n++] = (w - x0) / (x1 - x0);
+	if (n == 3 && ts[1] > ts[2]) {
+		const float t = ts[1];
+		ts[1] = ts[2];
+		ts[2] = t;
+	}
+	ts[n++] = 1.0f;
+
+	float px = x0;
+	float py = y0;
+	for (int i = 1; i < n; i++) {
+		const int last = i == n-1;
+		const float qx = last ? x1 : x0 + (x1 - x0) * ts[i];
+		const float qy = last ? y1 : y0 + (y1 - y0) * ts[i];
+		nanovg_sw__push_edge(sw, nanovg_sw__clampf(px, 0.0f, w), py, nanovg_sw__clampf(qx, 0.0f, w), qy);
+		px = qx;
+		py = qy;
+	}
+}
+
+/* the triangle's edges, turned so that its inside counts positive */
+static void nanovg_sw__triangle_edges(struct nanovg_sw* sw, const NVGvertex* a, const NVGvertex* b, const NVGvertex* c)
+{
+	const float s = sw->scale;
+	const float area = (b->x - a->x) * (c->y - a->y) - (b->y - a->y) * (c->x - a->x);
+	if (area == 0.0f) return;
+	if (area < 0.0f) {
+		const NVGvertex* t = b;
+		b = c;
+		c = t;
+	}
+	nanovg_sw__edge(sw, a->x*s, a->y*s, b->x*s, b->y*s);
+	nanovg_sw__edge(sw, b->x*s, b->y*s, c->x*s, c->y*s);
+	nanovg_sw__edge(sw, c->x*s, c->y*s, a->x*s, a->y*s);
+}
+
+static int nanovg_sw__render_create(void* uptr)
+{
+	(void)uptr;
+	return 1;
+}
+
+static void nanovg_sw__render_viewport(void* uptr, float width, float height, float device_pixel_ratio)
+{
+	struct nanovg_sw* sw = uptr;
+	(void)width;
+	(void)height;
+	sw->scale = device_pixel_ratio;
+}
+
+static void nanovg_sw__reset(struct nanovg_sw* sw)
+{
+	sw->n_calls = 0;
+	sw->n_edges = 0;
+	sw->n_tris = 0;
+	sw->n_prims = 0;
+}
+
+static void nanovg_sw__render_cancel(void* uptr)
+{
+	nanovg_sw__reset(uptr);
+}
+
+static void nanovg_sw__render_fill(void* uptr, NVGpaint* paint, NVGcompositeOperationState op, NVGscissor* scissor, float fringe, const float* bounds, const NVGpath* paths, int npaths)
+{
+	struct nanovg_sw* sw = uptr;
+	const float s = sw->scale;
+	struct nanovg_sw_call* c = nanovg_sw__begin_call(sw, NANOVG_SW_FILL);
+	nanovg_sw__begin_paint_call(sw, c, paint, op, scissor, fringe);
+	for (int i = 0; i < npaths; i++) {
+		const NVGvertex* v = paths[i].fill;
+		const int n = paths[i].nfill;
+		for (int j = 0; j < n; j++) {
+			const NVGvertex* a = &v[j];
+			const NVGvertex* b = &v[j+1 < n ? j+1 : 0];
+			nanovg_sw__edge(sw, a->x*s, a->y*s, b->x*s, b->y*s);
+		}
+	}
+	nanovg_sw__end_call(sw, c);
+}
+
+static void nanovg_sw__render_stroke(void* uptr, NVGpaint* paint, NVGcompositeOperationState op, NVGscissor* scissor, float fringe, float stroke_width, const NVGpath* paths, int npaths)
+{
+	struct nanovg_sw* sw = uptr;
+	struct nanovg_sw_call* c = nanovg_sw__begin_call(sw, NANOVG_SW_STROKE);
+	nanovg_sw__begin_paint_call(sw, c, paint, op, scissor, fringe);
+	for (int i = 0; i < npaths; i++) {
+		const NVGvertex* v = paths[i].stroke;
+		for (int j = 0; j+2 < paths[i].nstroke; j++) {
+			nanovg_sw__triangle_edges(sw, &v[j], &v[j+1], &v[j+2]);
+		}
+	}
+	nanovg_sw__end_call(sw, c);
+}
+
+static void nanovg_sw__render_triangles(void* uptr, NVGpaint* paint, NVGcompositeOperationState op, NVGscissor* scissor, const NVGvertex* verts, int nverts, float fringe)
+{
+	struct nanovg_sw* sw = uptr;
+	const float s = sw->scale;
+	struct nanovg_sw_call* c = nanovg_sw__begin_call(sw, NANOVG_SW_TRIANGLES);
+	nanovg_sw__begin_paint_call(sw, c, paint, op, scissor, fringe);
+	nanovg_sw__reserve((void**)&sw->tris, &sw->tris_cap, sw->n_tris + nverts/3, sizeof *sw->tris);
+	for (int i = 0; i+2 < nverts; i += 3) {
+		struct nanovg_sw_tri* t = &sw->tris[sw->n_tris++];
+		for (int k = 0; k < 3; k++) {
+			t->x[k] = verts[i+k].x * s;
+			t->y[k] = verts[i+k].y * s;
+			t->u[k] = verts[i+k].u;
+			t->v[k] = verts[i+k].v;
+		}
+	}
+	nanovg_sw__end_call(sw, c);
+}
+
+static void nanovg_sw__free_scratch(struct nanovg_sw* sw)
+{
+	if (sw->scratch == NULL) return;
+	for (int i = 0; i < sw->parallel.n_threads; i++) {
+		free(sw->scratch[i].acc);
+		free(sw->scratch[i].color);
+	}
+	free(sw->scratch);
+	sw->scratch = NULL;
+	sw->scratch_width = 0;
+}
+
+static void nanovg_sw__render_delete(void* uptr)
+{
+	struct nanovg_sw* sw = uptr;
+	if (sw == NULL) return;
+	for (int i = 0; i < sw->n_textures; i++) free(sw->textures[i].data);
+	free(sw->textures);
+	free(sw->calls);
+	free(sw->edges);
+	free(sw->tris);
+	free(sw->band_offsets);
+	free(sw->band_cursors);
+	free(sw->band_x0);
+	free(sw->band_x1);
+	free(sw->refs);
+	nanovg_sw__free_scratch(sw);
+	free(sw);
+}
+
+
+// drawing
+
+/* adds edge e's signed area to rows [y0;y1) of acc, whose first row is
+ * band_y0; the area stays within columns [x0;x1+1] (font-rs's
+ * Raster::draw_line(), clipped to the rows) */
+static void nanovg_sw__accumulate(float* acc, int stride, int band_y0, int y0, int y1, int x0, int x1, const struct nanovg_sw_edge* e)
+{
+	float ax = e->x0, ay = e->y0;
+	float bx = e->x1, by = e->y1;
+	float dir = 1.0f;
+	if (ay > by) {
+		ax = e->x1;
+		ay = e->y1;
+		bx = e->x0;
+		by = e->y0;
+		dir = -1.0f;
+	}
+	const float dxdy = (bx - ax) / (by - ay);
+	const int row_begin = nanovg_sw__maxi(y0, (int)floorf(ay));
+	const int row_end = nanovg_sw__mini(y1, (int)ceilf(by));
+	const float lo = (float)x0;
+	const float hi = (float)x1;
+	float x = ax + (fmaxf((float)row_begin, ay) - ay) * dxdy;
+	for (int y = row_begin; y < row_end; y++) {
+		float* row = acc + (y - band_y0) * stride;
+		const float dy = fminf((float)(y+1), by) - fmaxf((float)y, ay);
+		const float x_next = x + dxdy*dy;
+		const float d = dy*dir;
+		const float xl = nanovg_sw__clampf(fminf(x, x_next), lo, hi);
+		const float xr = nanovg_sw__clampf(fmaxf(x, x_next), lo, hi);
+		const float xl_floor = floorf(xl);
+		const int xli = (int)xl_floor;
+		const float xr_ceil = ceilf(xr);
+		const int xri = (int)xr_ceil;
+		if (xri <= xli + 1) {
+			const float xmf = 0.5f * (xl + xr) - xl_floor;
+			row[xli] += d - d*xmf;
+			row[xli+1] += d*xmf;
+		} else {
+			const float s = 1.0f / (xr - xl);
+			const float xlf = xl - xl_floor;
+			const float a0 = 0.5f * s * (1.0f - xlf) * (1.0f - xlf);
+			const float xrf = xr - xr_ceil + 1.0f;
+			const float am = 0.5f * s * xrf * xrf;
+			row[xli] += d*a0;
+			if (xri == xli + 2) {
+				row[xli+1] += d * (1.0f - a0 - am);
+			} else {
+				const float a1 = s * (1.5f - xlf);
+				row[xli+1] += d * (a1 - a0);
+				for (int xi = xli+2; xi < xri-1; xi++) row[xi] += d*s;
+				const float a2 = a1 + (float)(xri - xli - 3) * s;
+				row[xri-1] += d * (1.0f - a2 - am);
+			}
+			row[xri] += d*am;
+		}
+		x = x_next;
+	}
+}
+
+/* turns columns [x0;x1) of an accumulation row into coverage, in place */
+static void nanovg_sw__coverage(float* acc, int x0, int x1)
+{
+	int x = x0;
+	float sum = 0.0f;
+	#if defined(__SSE2__)
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 carry = _mm_setzero_ps();
+	for (; x+4 <= x1; x += 4) {
+		/* prefix sum of 4 lanes in two shifted adds */
+		__m128 v = _mm_loadu_ps(acc + x);
+		v = _mm_add_ps(v, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 4)));
+		v = _mm_add_ps(v, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 8)));
+		v = _mm_add_ps(v, carry);
+		carry = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3,3,3,3));
+		_mm_storeu_ps(acc + x, _mm_min_ps(one, _mm_and_ps(v, abs_mask)));
+	}
+	sum = _mm_cvtss_f32(carry);
+	#endif
+	for (; x < x1; x++) {
+		sum += acc[x];
+		acc[x] = fminf(1.0f, fabsf(sum));
+	}
+}
+
+static void nanovg_sw__draw_edges(const struct nanovg_sw* sw, struct nanovg_sw_scratch* s, const struct nanovg_sw_call* c, const int* refs, int n_refs, int band_y0, int band_y1)
+{
+	const int y0 = nanovg_sw__maxi(band_y0, c->y0);
+	const int y1 = nanovg_sw__mini(band_y1, c->y1);
+	const int stride = sw->width + 2;
+	for (int y = y0; y < y1; y++) {
+		memset(s->acc + (y - band_y0)*stride + c->x0, 0, (c->x1 - c->x0 + 2) * sizeof *s->acc);
+	}
+	for (int i = 0; i < n_refs; i++) {
+		const struct nanovg_sw_edge* e = &sw->edges[c->first + refs[i] - c->prim_first];
+		nanovg_sw__accumulate(s->acc, stride, band_y0, y0, y1, c->x0, c->x1, e);
+	}
+	for (int y = y0; y < y1; y++) {
+		float* acc = s->acc + (y - band_y0)*stride;
+		nanovg_sw__coverage(acc, c->x0, c->x1);
+		nanovg_sw__blend_row(sw, c, s->color + (y - band_y0)*sw->width*4, acc, c->x0, c->x1, y);
+	}
+}
+
+/* is the edge from a to b (seen from a triangle of positive area) the one
+ * that gets the pixel centers exactly on it? Exactly one of two triangles
+ * sharing it says yes */
+static inline int nanovg_sw__owns_edge(int64_t ax, int64_t ay, int64_t bx, int64_t by)
+{
+	return by > ay || (by == ay && bx < ax);
+}
+
+static void nanovg_sw__draw_triangle(const struct nanovg_sw* sw, float* color, const struct nanovg_sw_call* c, const struct nanovg_sw_tri* t, int band_y0, int band_y1)
+{
+	const float one = (float)(1 << NANOVG_SW_SUBPIXEL_BITS);
+	int64_t xs[3], ys[3];
+	float min_x = INFINITY, min_y = INFINITY;
+	float max_x = -INFINITY, max_y = -INFINITY;
+	for (int k = 0; k < 3; k++) {
+		xs[k] = (int64_t)lrintf(nanovg_sw__clampf(t->x[k], -NANOVG_SW_MAX_COORDINATE, NANOVG_SW_MAX_COORDINATE) * one);
+		ys[k] = (int64_t)lrintf(nanovg_sw__clampf(t->y[k], -NANOVG_SW_MAX_COORDINATE, NANOVG_SW_MAX_COORDINATE) * one);
+		min_x = fminf(min_x, t->x[k]);
+		max_x = fmaxf(max_x, t->x[k]);
+		min_y = fminf(min_y, t->y[k]);
+		max_y = fmaxf(max_y, t->y[k]);
+	}
+	int64_t area = (xs[1] - xs[0]) * (ys[2] - ys[0]) - (ys[1] - ys[0]) * (xs[2] - xs[0]);
+	if (area == 0) return;
+	// vertex order a, b, c with positive area
+	int ia = 0, ib = 1, ic = 2;
+	if (area < 0) {
+		ib = 2;
+		ic = 1;
+		area = -area;
+	}
+	const int64_t ax = xs[ia], ay = ys[ia];
+	const int64_t bx = xs[ib], by = ys[ib];
+	const int64_t cx = xs[ic], cy = ys[ic];
+
+	const int x0 = (int)floorf(nanovg_sw__clampf(min_x, (float)c->x0, (float)c->x1));
+	const int x1 = (int)ceilf(nanovg_sw__clampf(max_x, (float)c->x0, (float)c->x1));
+	const int y0 = (int)floorf(nanovg_sw__clampf(min_y, (float)nanovg_sw__maxi(band_y0, c->y0), (float)nanovg_sw__mini(band_y1, c->y1)));
+	const int y1 = (int)ceilf(nanovg_sw__clampf(max_y, (float)nanovg_sw__maxi(band_y0, c->y0), (float)nanovg_sw__mini(band_y1, c->y1)));
+
+	/* edge functions, each the weight of the vertex across; a pixel
+	 * center on an edge it doesn't own is out (bias -1) */
+	const int64_t bias_a = nanovg_sw__owns_edge(bx, by, cx, cy) ? 0 : -1;
+	const int64_t bias_b = nanovg_sw__owns_edge(cx, cy, ax, ay) ? 0 : -1;
+	const int64_t bias_c = nanovg_sw__owns_edge(ax, ay, bx, by) ? 0 : -1;
+	const int64_t step = 1 << NANOVG_SW_SUBPIXEL_BITS;
+	const int64_t half = step / 2;
+	const float inv_area = 1.0f / (float)area;
+	const float inv_scale = 1.0f / sw->scale;
+	const float* us = t->u;
+	const float* vs = t->v;
+	for (int y = y0; y < y1; y++) {
+		const int64_t px = x0*step + half;
+		const int64_t py = y*step + half;
+		int64_t wa = (cx - bx) * (py - by) - (cy - by) * (px - bx);
+		int64_t wb = (ax - cx) * (py - cy) - (ay - cy) * (px - cx);
+		int64_t wc = (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+		const int64_t da = -(cy - by) * step;
+		const int64_t db = -(ay - cy) * step;
+		const int64_t dc = -(by - ay) * step;
+		float* row = color + (y - band_y0)*sw->width*4;
+		for (int x = x0; x < x1; x++, wa += da, wb += db, wc += dc) {
+			if (wa + bias_a < 0 || wb + bias_b < 0 || wc + bias_c < 0) continue;
+			const float la = (float)wa * inv_area;
+			const float lb = (float)wb * inv_area;
+			const float lc = (float)wc * inv_area;
+			float src[4];
+			if (c->paint.image != 0) {
+				nanovg_sw__image_color(&c->paint, la*us[ia] + lb*us[ib] + lc*us[ic], la*vs[ia] + lb*vs[ib] + lc*vs[ic], src);
+			} else {
+				memcpy(src, c->paint.inner, sizeof src);
+			}
+			if (c->paint.has_scissor) {
+				const float mask = nanovg_sw__scissor_mask(&c->paint, (x + 0.5f) * inv_scale, (y + 0.5f) * inv_scale);
+				for (int i = 0; i < 4; i++) src[i] *= mask;
+			}
+			nanovg_sw__blend(c, row + x*4, src);
+		}
+	}
+}
+
+static void nanovg_sw__draw_triangles(const struct nanovg_sw* sw, struct nanovg_sw_scratch* s, const struct nanovg_sw_call* c, const int* refs, int n_refs, int band_y0, int band_y1)
+{
+	for (int i = 0; i < n_refs; i++) {
+		const struct nanovg_sw_tri* t = &sw->tris[c->first + refs[i] - c->prim_first];
+		nanovg_sw__draw_triangle(sw, s->color, c, t, band_y0, band_y1);
+	}
+}
+
+static void nanovg_sw__draw_clear(const struct nanovg_sw* sw, struct nanovg_sw_scratch* s, const struct nanovg_sw_call* c, int band_y0, int band_y1)
+{
+	for (int y = band_y0; y < band_y1; y++) {
+		float* p = s->color + (y - band_y0)*sw->width*4;
+		for (int x = 0; x < sw->width; x++) memcpy(p + x*4, c->clear_color, 4 * sizeof *p);
+	}
+}
+
+/* framebuffer pixels [x0;x1) of rows [y0;y1) to and from floats */
+static void nanovg_sw__load(const struct nanovg_sw* sw, float* color, int y0, int y1, int x0, int x1)
+{
+	for (int y = y0; y < y1; y++) {
+		const unsigned char* src = sw->framebuffer + (size_t)y*sw->stride;
+		float* dst = color + (y - y0)*sw->width*4;
+		#if defined(__SSE2__)
+		const __m128 k = _mm_set1_ps(1.0f / 255.0f);
+		const __m128i zero = _mm_setzero_si128();
+		for (int x = x0; x < x1; x++) {
+			int32_t bytes;
+			memcpy(&bytes, src + x*4, sizeof bytes);
+			__m128i p = _mm_cvtsi32_si128(bytes);
+			p = _mm_unpacklo_epi16(_mm_unpacklo_epi8(p, zero), zero);
+			_mm_storeu_ps(dst + x*4, _mm_mul_ps(_mm_cvtepi32_ps(p), k));
+		}
+		#else
+		for (int x = x0*4; x < x1*4; x++) dst[x] = src[x] * (1.0f / 255.0f);
+		#endif
+	}
+}
+
+static void nanovg_sw__store(const struct nanovg_sw* sw, const float* color, int y0, int y1, int x0, int x1)
+{
+	for (int y = y0; y < y1; y++) {
+		unsigned char* dst = sw->framebuffer + (size_t)y*sw->stride;
+		const float* src = color + (y - y0)*sw->width*4;
+		#if defined(__SSE2__)
+		const __m128 k = _mm_set1_ps(255.0f);
+		for (int x = x0; x < x1; x++) {
+			__m128i p = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + x*4), k));
+			p = _mm_packus_epi16(_mm_packs_epi32(p, p), p);
+			const int32_t bytes = _mm_cvtsi128_si32(p);
+			memcpy(dst + x*4, &bytes, sizeof bytes);
+		}
+		#else
+		for (int x = x0*4; x < x1*4; x++) dst[x] = (unsigned char)lrintf(nanovg_sw__clampf(src[x], 0.0f, 1.0f) * 255.0f);
+		#endif
+	}
+}
+
+/* index of the call that primitive prim belongs to */
+static int nanovg_sw__find_call(const struct nanovg_sw* sw, int prim)
+{
+	int lo = 0;
+	int hi = sw->n_calls - 1;
+	while (lo < hi) {
+		const int mid = (lo + hi + 1) / 2;
+		if (sw->calls[mid].prim_first <= prim) lo = mid; else hi = mid - 1;
+	}
+	return lo;
+}
+
+static void nanovg_sw__band_job(void* usr, int band, int thread_index)
+{
+	const struct nanovg_sw* sw = usr;
+	const int begin = sw->band_offsets[band];
+	const int end = sw->band_offsets[band+1];
+	if (begin == end) return;
+	struct nanovg_sw_scratch* s = &sw->scratch[thread_index];
+	const int y0 = band * NANOVG_SW_BAND_HEIGHT;
+	const int y1 = nanovg_sw__mini(sw->height, y0 + NANOVG_SW_BAND_HEIGHT);
+	const int x0 = sw->band_x0[band];
+	const int x1 = sw->band_x1[band];
+
+	int call_index = nanovg_sw__find_call(sw, sw->refs[begin]);
+	/* a clear covers the whole band */
+	if (sw->calls[call_index].type != NANOVG_SW_CLEAR) nanovg_sw__load(sw, s->color, y0, y1, x0, x1);
+	for (int i = begin; i < end;) {
+		while (sw->calls[call_index].prim_first + sw->calls[call_index].count <= sw->refs[i]) call_index++;
+		const struct nanovg_sw_call* c = &sw->calls[call_index];
+		int j = i+1;
+		while (j < end && sw->refs[j] < c->prim_first + c->count) j++;
+		switch (c->type) {
+		case NANOVG_SW_CLEAR:
+			nanovg_sw__draw_clear(sw, s, c, y0, y1);
+			break;
+		case NANOVG_SW_FILL:
+		case NANOVG_SW_STROKE:
+			nanovg_sw__draw_edges(sw, s, c, sw->refs + i, j - i, y0, y1);
+			break;
+		case NANOVG_SW_TRIANGLES:
+			nanovg_sw__draw_triangles(sw, s, c, sw->refs + i, j - i, y0, y1);
+			break;
+		}
+		i = j;
+	}
+	nanovg_sw__store(sw, s->color, y0, y1, x0, x1);
+}
+
+/* rows [*y0;*y1) that primitive k of call c touches */
+static void nanovg_sw__prim_rows(const struct nanovg_sw* sw, const struct nanovg_sw_call* c, int k, int* y0, int* y1)
+{
+	float min_y, max_y;
+	if (c->type == NANOVG_SW_CLEAR) {
+		*y0 = c->y0;
+		*y1 = c->y1;
+		return;
+	} else if (c->type == NANOVG_SW_TRIANGLES) {
+		const struct nanovg_sw_tri* t = &sw->tris[c->first + k];
+		min_y = fminf(t->y[0], fminf(t->y[1], t->y[2]));
+		max_y = fmaxf(t->y[0], fmaxf(t->y[1], t->y[2]));
+	} else {
+		const struct nanovg_sw_edge* e = &sw->edges[c->first + k];
+		min_y = fminf(e->y0, e->y1);
+		max_y = fmaxf(e->y0, e->y1);
+	}
+	*y0 = (int)floorf(nanovg_sw__clampf(min_y, (float)c->y0, (float)c->y1));
+	*y1 = (int)ceilf(nanovg_sw__clampf(max_y, (float)c->y0, (float)c->y1));
+}
+
+/* sorts the frame's primitives into bands by a (stable) counting sort */
+static int nanovg_sw__bin(struct nanovg_sw* sw)
+{
+	const int n_bands = (sw->height + NANOVG_SW_BAND_HEIGHT - 1) / NANOVG_SW_BAND_HEIGHT;
+	if (n_bands+1 > sw->bands_cap) {
+		sw->bands_cap = n_bands+1;
+		sw->band_offsets = xrealloc(sw->band_offsets, sw->bands_cap * sizeof *sw->band_offsets);
+		sw->band_cursors = xrealloc(sw->band_cursors, sw->bands_cap * sizeof *sw->band_cursors);
+		sw->band_x0 = xrealloc(sw->band_x0, sw->bands_cap * sizeof *sw->band_x0);
+		sw->band_x1 = xrealloc(sw->band_x1, sw->bands_cap * sizeof *sw->band_x1);
+	}
+
+	for (int b = 0; b <= n_bands; b++) {
+		sw->band_offsets[b] = 0;
+		sw->band_x0[b] = sw->width;
+		sw->band_x1[b] = 0;
+	}
+	for (int i = 0; i < sw->n_calls; i++) {
+		const struct nanovg_sw_call* c = &sw->calls[i];
+		for (int k = 0; k < c->count; k++) {
+			int y0, y1;
+			nanovg_sw__prim_rows(sw, c, k, &y0, &y1);
+			if (y0 >= y1) continue;
+			const int last = (y1 - 1) / NANOVG_SW_BAND_HEIGHT;
+			for (int b = y0 / NANOVG_SW_BAND_HEIGHT; b <= last; b++) {
+				sw->band_offsets[b+1]++;
+				if (c->x0 < sw->band_x0[b]) sw->band_x0[b] = c->x0;
+				if (c->x1 > sw->band_x1[b]) sw->band_x1[b] = c->x1;
+			}
+		}
+	}
+	for (int b = 0; b < n_bands; b++) {
+		sw->band_offsets[b+1] += sw->band_offsets[b];
+		sw->band_cursors[b] = sw->band_offsets[b];
+	}
+
+	nanovg_sw__reserve((void**)&sw->refs, &sw->refs_cap, sw->band_offsets[n_bands], sizeof *sw->refs);
+	for (int i = 0; i < sw->n_calls; i++) {
+		const struct nanovg_sw_call* c = &sw->calls[i];
+		for (int k = 0; k < c->count; k++) {
+			int y0, y1;
+			nanovg_sw__prim_rows(sw, c, k, &y0, &y1);
+			if (y0 >= y1) continue;
+			const int last = (y1 - 1) / NANOVG_SW_BAND_HEIGHT;
+			for (int b = y0 / NANOVG_SW_BAND_HEIGHT; b <= last; b++) {
+				sw->refs[sw->band_cursors[b]++] = c->prim_first + k;
+			}
+		}
+	}
+	return n_bands;
+}
+
+static void nanovg_sw__render_flush(void* uptr)
+{
+	struct nanovg_sw* sw = uptr;
+	if (sw->framebuffer == NULL || sw->n_calls == 0) {
+		nanovg_sw__reset(sw);
+		return;
+	}
+
+	/* textures can come and go while the frame records (the glyph
+	 * atlas), but not while it draws */
+	for (int i = 0; i < sw->n_calls; i++) {
+		struct nanovg_sw_paint* p = &sw->calls[i].paint;
+		p->tex = p->image != 0 ? nanovg_sw__texture(sw, p->image) : NULL;
+	}
+
+	if (sw->scratch_width != sw->width) {
+		nanovg_sw__free_scratch(sw);
+		sw->scratch = xcalloc(sw->parallel.n_threads, sizeof *sw->scratch);
+		for (int i = 0; i < sw->parallel.n_threads; i++) {
+			sw->scratch[i].acc = xcalloc((size_t)NANOVG_SW_BAND_HEIGHT * (sw->width + 2), sizeof *sw->scratch[i].acc);
+			sw->scratch[i].color = xcalloc((size_t)NANOVG_SW_BAND_HEIGHT * sw->width * 4, sizeof *sw->scratch[i].color);
+		}
+		sw->scratch_width = sw->width;
+	}
+
+	const int n_bands = nanovg_sw__bin(sw);
+	if (sw->parallel.run != NULL) {
+		sw->parallel.run(sw->parallel.usr, n_bands, nanovg_sw__band_job, sw);
+	} else {
+		for (int b = 0; b < n_bands; b++) nanovg_sw__band_job(sw, b, 0);
+	}
+	nanovg_sw__reset(sw);
+}
+
+NVGcontext* nanovg_sw_create(const struct nanovg_sw_parallel* parallel)
+{
+	struct nanovg_sw* sw = xcalloc(1, sizeof *sw);
+	if (parallel != NULL) sw->parallel = *parallel;
+	if (sw->parallel.run == NULL || sw->parallel.n_threads < 1) sw->parallel.n_threads = 1;
+	sw->scale = 1.0f;
+
+	NVGparams params;
+	memset(&params, 0, sizeof params);
+	params.userPtr = sw;
+	/* coverage is analytic; see the top of the file */
+	params.edgeAntiAlias = 0;
+	params.renderCreate = nanovg_sw__render_create;
+	params.renderCreateTexture = nanovg_sw__render_create_texture;
+	params.renderDeleteTexture = nanovg_sw__render_delete_texture;
+	params.renderUpdateTexture = nanovg_sw__render_update_texture;
+	params.renderGetTextureSize = nanovg_sw__render_get_texture_size;
+	params.renderViewport = nanovg_sw__render_viewport;
+	params.renderCancel = nanovg_sw__render_cancel;
+	params.renderFlush = nanovg_sw__render_flush;
+	params.renderFill = nanovg_sw__render_fill;
+	params.renderStroke = nanovg_sw__render_stroke;
+	params.renderTriangles = nanovg_sw__render_triangles;
+	params.renderDelete = nanovg_sw__render_delete;
+
+	return nvgCreateInternal(&params);
+}
+
+void nanovg_sw_delete(NVGcontext* vg)
+{
+	nvgDeleteInternal(vg);
+}
+
+void nanovg_sw_set_framebuffer(NVGcontext* vg, unsigned char* rgba, int width, int height, int stride)
+{
+	struct nanovg_sw* sw = nanovg_sw__get(vg);
+	sw->framebuffer = rgba;
+	sw->width = width;
+	sw->height = height;
+	sw->stride = stride;
+}
+
+void nanovg_sw_clear(NVGcontext* vg, NVGcolor color)
+{
+	struct nanovg_sw* sw = nanovg_sw__get(vg);
+	if (sw->width <= 0 || sw->height <= 0) return;
+	struct nanovg_sw_call* c = nanovg_sw__begin_call(sw, NANOVG_SW_CLEAR);
+	memcpy(c->clear_color, color.rgba, sizeof c->clear_color);
+	c->count = 1;
+	c->x0 = 0;
+	c->y0 = 0;
+	c->x1 = sw->width;
+	c->y1 = sw->height;
+	c->prim_first = sw->n_prims;
+	sw->n_prims += c->count;
+}
@@ -0,0 +1,28 @@
+#ifndef NANOVG_SW_H
+#define NANOVG_SW_H
+
+#include "nanovg.h"
+
+/* nanovg backend that renders on the CPU into premultiplied RGBA8 in
+ * memory: thumbnails without a GPU, and render timings that don't depend
+ * on the driver. See nanovg_sw.c */
+
+/* runs fn(fn_usr, job_index, thread_index) for job_index 0..n_jobs-1 and
+ * returns when all are done; thread_index < n_threads, and no two jobs
+ * run on the same thread_index at once */
+struct nanovg_sw_parallel {
+	void (*run)(void* usr, int n_jobs, void (*fn)(void* fn_usr, int job_index, int thread_index), void* fn_usr);
+	void* usr;
+	int n_threads;
+};
+
+/* parallel may be NULL to render on the calling thread */
+NVGcontext* nanovg_sw_create(const struct nanovg_sw_parallel* parallel);
+void nanovg_sw_delete(NVGcontext* vg);
+/* the buffer nvgEndFrame() renders into; stride is in bytes */
+void nanovg_sw_set_framebuffer(NVGcontext* vg, unsigned char* rgba, int width, int height, int stride);
+/* fills the framebuffer with color as is, like glClear(); takes effect in
+ * order with the frame's drawing, at nvgEndFrame() */
+void nanovg_sw_clear(NVGcontext* vg, NVGcolor color);
+
+#endif